@@ -0,0 +1,69 @@
+// Times Bvh construction over a procedural terrain mesh, serially and on the global thread pool.
+// Usage: bvh_benchmark [quads per side = 1024] [runs = 3]
+
+#include "core_types.h"
+#include "vertex.h"
+#include "heightfield.h"
+#include "thread_pool.h"
+#include "bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+template <typename F>
+float64 bestOf(uint32 runs, F&& f) {
+    float64 best = 1e30;
+    for (uint32 r = 0; r < runs; r++) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<float64>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const uint32 size = argc > 1 ? std::atoi(argv[1]) : 1024;
+    const uint32 runs = argc > 2 ? std::atoi(argv[2]) : 3;
+    const uint32 samples = size + 1;
+
+    cglib::HeightfieldGenerator<float32> generator(1000, 100, 5, 0.5f, 2.0f);
+    const std::vector<float32> heights = generator.generate(samples, samples, 0, 0, 1);
+
+    std::vector<cglib::Vertex<float32>> vertices(static_cast<uint64>(samples) * samples);
+    for (uint32 i = 0; i < samples; i++) {
+        for (uint32 j = 0; j < samples; j++) {
+            const uint64 k = static_cast<uint64>(i) * samples + j;
+            vertices[k].Position = {static_cast<float32>(i), heights[k], static_cast<float32>(j)};
+        }
+    }
+
+    std::vector<uint32> indices;
+    indices.reserve(static_cast<uint64>(size) * size * 6);
+    for (uint32 i = 0; i < size; i++) {
+        for (uint32 j = 0; j < size; j++) {
+            const uint32 v = i * samples + j;
+            indices.insert(indices.end(), {v, v + 1, v + samples, v + 1, v + samples + 1, v + samples});
+        }
+    }
+
+    cglib::ThreadPool& pool = cglib::ThreadPool::global();
+    std::cout << "Triangles: " << indices.size() / 3 << ", threads: " << pool.size() << std::endl;
+
+    uint64 numNodes = 0;
+    const float64 serial = bestOf(runs, [&] {
+        cglib::Bvh<float32> bvh(vertices, indices);
+        numNodes = bvh.getNodes().size();
+    });
+    const float64 parallel = bestOf(runs, [&] {
+        cglib::Bvh<float32> bvh(vertices, indices, 4, &pool);
+    });
+
+    std::cout << "Nodes: " << numNodes << std::endl;
+    std::cout << "Serial build: " << serial * 1000 << " ms" << std::endl;
+    std::cout << "Parallel build: " << parallel * 1000 << " ms (" << serial / parallel << "x)" << std::endl;
+    return 0;
+}
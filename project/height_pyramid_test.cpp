@@ -0,0 +1,67 @@
+// Compares HeightPyramid region queries against a brute force scan of the grid, for random grids and regions
+// inside, straddling and outside the grid. Exits with 1 on the first mismatch.
+
+#include "core_types.h"
+#include "height_grid.h"
+#include "height_pyramid.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <random>
+
+int main() {
+    std::mt19937 random(1);
+    auto uniform = [&](int64 min, int64 max) {
+        return std::uniform_int_distribution<int64>(min, max)(random);
+    };
+
+    uint32 numQueries = 0;
+    for (uint32 grid = 0; grid < 200; grid++) {
+        const uint32 width = uniform(1, 40), depth = uniform(1, 40);
+        const cglib::HeightGridLayout layout = grid % 2 ? cglib::HeightGridLayout::TILED : cglib::HeightGridLayout::ROW_MAJOR;
+        cglib::HeightGrid<float32> height(width, depth, 0, layout);
+        for (uint32 x = 0; x < width; x++) {
+            for (uint32 z = 0; z < depth; z++) {
+                height(x, z) = uniform(-50, 50);
+            }
+        }
+        const cglib::HeightPyramid<float32> pyramid(height);
+
+        for (uint32 query = 0; query < 500; query++, numQueries++) {
+            const int64 margin = 2 * std::max(width, depth);
+            const int64 x0 = uniform(-margin, width + margin), x1 = uniform(-margin, width + margin);
+            const int64 z0 = uniform(-margin, depth + margin), z1 = uniform(-margin, depth + margin);
+            const int64 xMin = std::min(x0, x1), xMax = std::max(x0, x1);
+            const int64 zMin = std::min(z0, z1), zMax = std::max(z0, z1);
+            const float32 y = uniform(-55, 55);
+
+            float32 expectedMax = std::numeric_limits<float32>::lowest();
+            for (int64 x = std::max<int64>(xMin, 0); x <= std::min<int64>(xMax, width - 1); x++) {
+                for (int64 z = std::max<int64>(zMin, 0); z <= std::min<int64>(zMax, depth - 1); z++) {
+                    expectedMax = std::max(expectedMax, height(x, z));
+                }
+            }
+            const bool expectedAny = expectedMax >= y;
+
+            int64 maxX = -1, maxZ = -1;
+            const float32 max = pyramid.maxInRegion(xMin, zMin, xMax, zMax, maxX, maxZ);
+            const bool any = pyramid.anyAtLeast(xMin, zMin, xMax, zMax, y);
+            const bool located = max == std::numeric_limits<float32>::lowest() ||
+                                 (maxX >= std::max<int64>(xMin, 0) && maxX <= std::min<int64>(xMax, width - 1) &&
+                                  maxZ >= std::max<int64>(zMin, 0) && maxZ <= std::min<int64>(zMax, depth - 1) &&
+                                  height(maxX, maxZ) == max);
+
+            if (any != expectedAny || max != expectedMax || !located) {
+                std::cout << "Mismatch on a " << width << "x" << depth << " grid, region x[" << xMin << ", " << xMax
+                          << "] z[" << zMin << ", " << zMax << "], y " << y << ": anyAtLeast " << any << " (expected "
+                          << expectedAny << "), maxInRegion " << max << " at (" << maxX << ", " << maxZ
+                          << ") (expected " << expectedMax << ")" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    std::cout << "Queries: " << numQueries << ", all match" << std::endl;
+    return 0;
+}
@@ -110,10 +110,14 @@ int main()
     cglib::Model<float32> terrainModel("./project/models/terrain/terrain.obj");
     terrainModel.getNodes()[1].meshes[0].addTexture("texture_diffuse", "./project/models/terrain/diff2.jpg");
     terrainModel.getNodes()[1].meshes[0].addTexture("texture_normal", "./project/models/terrain/nrm.png");
+    // Static, the world transforms are computed on the first draw and never again
+    terrainModel.setLocalTransform(0, cglib::translate<float32>(0, 0, 1000.0f));
     //terrainModel.print();
 
     // Drone
     cglib::Model droneModel("./project/models/drone/drone_obj.obj");
+    const cglib::NodeHandle leftRotor("Rotor_L_Cube.007");
+    const cglib::NodeHandle rightRotor("Rotor_R_Cube.012");
     droneModel.print();
 
     // Cubemap
@@ -213,6 +217,9 @@ int main()
         deltaTime = currFrame - lastFrame;
         lastFrame = currFrame;
 
+        // Upload the textures decoded in the background since the last frame
+        cglib::TextureLoader::processCompleted();
+
         cglib::Vec3<float32> oldPosition = drone.getPosition();
         cglib::Quat<float32> oldOrientation = drone.getOrientation();
 
@@ -230,7 +237,13 @@ int main()
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        if (collisionDetector.hasCollided(drone.getPosition(), bBoxScale) || !isInLand(drone.getPosition())) {
+        // Stop the drone where it first touches the terrain along its movement, not only at its new position
+        const cglib::SweepResult<float32> sweep = collisionDetector.sweep(oldPosition, drone.getPosition(), bBoxScale);
+        if (sweep.hit) {
+            drone.setPosition(oldPosition + sweep.time * (drone.getPosition() - oldPosition));
+            drone.setOrientation(oldOrientation);
+        }
+        if (!isInLand(drone.getPosition())) {
             drone.setPosition(oldPosition);
             drone.setOrientation(oldOrientation);
         }
@@ -254,11 +267,9 @@ int main()
         auto lookAtPosition = lookAt.first;
         lookAtView = lookAt.second;
 
-        droneModel.getNodes()[0].model = model;
-        droneModel.getNodes()[3].model = cglib::translate(0.25f, 0.0f, 0.0f).dot(cglib::rotateY(currFrame * -1000.0f)).dot(cglib::translate(-0.25f, -0.0f, -0.0f));
-        droneModel.getNodes()[5].model = cglib::translate(-0.25f, 0.0f, 0.0f).dot(cglib::rotateY(currFrame * -1000.0f)).dot(cglib::translate(+0.25f, -0.0f, -0.0f));
-
-        droneModel.updateModelMatrices();
+        droneModel.setLocalTransform(0, model);
+        droneModel.setLocalTransform(leftRotor, cglib::translate(0.25f, 0.0f, 0.0f).dot(cglib::rotateY(currFrame * -1000.0f)).dot(cglib::translate(-0.25f, -0.0f, -0.0f)));
+        droneModel.setLocalTransform(rightRotor, cglib::translate(-0.25f, 0.0f, 0.0f).dot(cglib::rotateY(currFrame * -1000.0f)).dot(cglib::translate(+0.25f, -0.0f, -0.0f)));
 
         if (lookAtMode) {
             droneProgram.setVec3("viewPos", lookAtPosition);
@@ -268,8 +279,6 @@ int main()
             droneModel.draw(droneProgram, projection, cameraView);
         }
 
-        droneModel.resetModelMatrices();
-
         // // Debug
         // cubeShader.use();
         // cubeShader.setMat4("model", cglib::translate(drone.getPosition()).dot(cglib::scale(bBoxScale)));
@@ -289,9 +298,6 @@ int main()
         terrainProgram.setVec3("spotLight.position", spotLight.position);
         terrainProgram.setVec3("spotLight.direction", spotLight.direction);
 
-        terrainModel.getNodes()[0].model = cglib::translate<float32>(0, 0, 1000.0f);
-        terrainModel.updateModelMatrices();
-
         if (lookAtMode) {
             terrainProgram.setVec3("viewPos", lookAtPosition);
             terrainModel.draw(terrainProgram, projection, lookAtView);
@@ -300,8 +306,6 @@ int main()
             terrainModel.draw(terrainProgram, projection, cameraView);
         }
 
-        terrainModel.resetModelMatrices();
-
         // Skybox
         skyboxProgram.use();
 
@@ -327,6 +331,8 @@ int main()
     }
 
     // clear resources
+    // Textures still referenced by the models below are destroyed with the context
+    cglib::TextureLoader::shutdown();
     glfwTerminate();
 
     return 0;
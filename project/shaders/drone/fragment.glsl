@@ -65,10 +65,12 @@ vec3 computeSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 void main()
 {
     // properties
-    vec3 normal = texture(texture_normal1, TexCoord).rgb;
-
-    // transform normal vector to range [-1,1]
-    normal = normalize(normal * 2.0 - 1.0);
+    // transform normal vector to range [-1,1], z is rebuilt from x and y since
+    // compressed normal maps (BC5) only store two channels
+    vec3 normal;
+    normal.xy = texture(texture_normal1, TexCoord).rg * 2.0 - 1.0;
+    normal.z = sqrt(max(0.0, 1.0 - dot(normal.xy, normal.xy)));
+    normal = normalize(normal);
 
     // normal in world space
     normal = normalize(TBN * normal);
@@ -3,6 +3,9 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
 layout (location = 3) in vec3 aTangent;
+// Per instance, see cglib::InstanceData (a mat4 spans locations 4-7, a mat3 locations 8-10)
+layout (location = 4) in mat4 aInstanceModel;
+layout (location = 8) in mat3 aInstanceNormalMatrix;
 
 out vec3 FragPos;
 out vec2 TexCoord;
@@ -12,13 +15,21 @@ uniform mat4 model;
 uniform mat4 modelViewProjection;
 uniform mat3 normalMatrix;
 
+// Instanced draws read the transforms from the instance attributes instead
+uniform bool instanced;
+uniform mat4 viewProjection;
+
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    mat4 worldMatrix = instanced ? aInstanceModel : model;
+    mat3 worldNormalMatrix = instanced ? aInstanceNormalMatrix : normalMatrix;
+
+    vec4 worldPos = worldMatrix * vec4(aPos, 1.0);
+    FragPos = vec3(worldPos);
 
     // Compute TBN
-    vec3 T = normalize(normalMatrix * aTangent);
-    vec3 N = normalize(normalMatrix * aNormal);
+    vec3 T = normalize(worldNormalMatrix * aTangent);
+    vec3 N = normalize(worldNormalMatrix * aNormal);
 
     // Reorthogonalization trick to make sure that T is orthogonal to N
     T = normalize(T - dot(T, N) * N);
@@ -28,5 +39,5 @@ void main()
 
     TexCoord = aTexCoord;
 
-    gl_Position = modelViewProjection * vec4(aPos, 1.0);
+    gl_Position = instanced ? viewProjection * worldPos : modelViewProjection * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "core_types.h"
+#include "mat4.h"
+#include "vec3.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace cglib {
+
+// Points handled by a single task when a batch is split across threads
+constexpr uint64 TRANSFORM_GRAIN = 1 << 16;
+
+/**
+ * Transforms n points stored as separate x, y, z arrays by the affine matrix m (last row 0 0 0 1).
+ * If a pool is given the batch is split across its threads.
+ */
+template <typename T = float32>
+void transformPoints(const Mat4<T>& m, const T* xs, const T* ys, const T* zs,
+                     T* outX, T* outY, T* outZ, uint64 n, ThreadPool* pool = nullptr) {
+    if (pool == nullptr || n <= TRANSFORM_GRAIN) {
+        simd::transformPointsSoA(m.v, xs, ys, zs, outX, outY, outZ, n);
+        return;
+    }
+
+    pool->parallelFor(0, n, TRANSFORM_GRAIN, [&](uint64 begin, uint64 end) {
+        simd::transformPointsSoA(m.v, xs + begin, ys + begin, zs + begin,
+                                 outX + begin, outY + begin, outZ + begin, end - begin);
+    });
+}
+
+/**
+ * Transforms n packed points by the affine matrix m (last row 0 0 0 1). in and out may be the same array.
+ * Points are deinterleaved in small blocks so the SoA kernel can be used.
+ */
+template <typename T = float32>
+void transformPoints(const Mat4<T>& m, const Vec3<T>* in, Vec3<T>* out, uint64 n, ThreadPool* pool = nullptr) {
+    auto transformRange = [&](uint64 begin, uint64 end) {
+        constexpr uint64 BLOCK = 256;
+        T xs[BLOCK], ys[BLOCK], zs[BLOCK];
+        T ox[BLOCK], oy[BLOCK], oz[BLOCK];
+
+        for (uint64 i = begin; i < end; i += BLOCK) {
+            const uint64 count = std::min(BLOCK, end - i);
+            for (uint64 j = 0; j < count; j++) {
+                xs[j] = in[i + j].x; ys[j] = in[i + j].y; zs[j] = in[i + j].z;
+            }
+
+            simd::transformPointsSoA(m.v, xs, ys, zs, ox, oy, oz, count);
+
+            for (uint64 j = 0; j < count; j++) {
+                out[i + j].x = ox[j]; out[i + j].y = oy[j]; out[i + j].z = oz[j];
+            }
+        }
+    };
+
+    if (pool == nullptr || n <= TRANSFORM_GRAIN) {
+        transformRange(0, n);
+    } else {
+        pool->parallelFor(0, n, TRANSFORM_GRAIN, transformRange);
+    }
+}
+
+}; // namespace cglib
@@ -0,0 +1,731 @@
+#pragma once
+
+#include "core_types.h"
+#include "vec3.h"
+#include "vertex.h"
+#include "simd.h"
+#include "batch_transform.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace cglib {
+
+template <typename T>
+struct Node;
+
+/**
+ * Bounding volume hierarchy over the triangles of an indexed mesh, built with the binned surface area heuristic.
+ *
+ * Nodes are stored depth first in a single array: the left child of an inner node directly follows it,
+ * and triangles are copied in leaf order so that a leaf reads one contiguous range.
+ * Queries are in the space of the vertices (e.g. mesh local space, transform queries with the inverse model matrix).
+ */
+template <typename T = float32>
+class Bvh {
+public:
+    struct Node {
+        Vec3<T> boundsMin;
+        // Leaf: first triangle, inner node: index of the right child
+        uint32 offset;
+        Vec3<T> boundsMax;
+        // Triangles in a leaf, 0 for inner nodes
+        uint32 count;
+
+        bool isLeaf() const {
+            return count > 0;
+        }
+    };
+
+    struct RayHit {
+        bool hit = false;
+        // Along the ray direction, in units of its length
+        T distance = std::numeric_limits<T>::max();
+        // Index of the triangle in the source index buffer (i.e. first index / 3)
+        uint32 triangle = 0;
+        // Barycentric coordinates of the hit point relative to the second and third vertices
+        T u = 0, v = 0;
+    };
+
+    struct ClosestPoint {
+        bool found = false;
+        Vec3<T> point;
+        T distance = std::numeric_limits<T>::max();
+        uint32 triangle = 0;
+    };
+
+private:
+    // Deeper nodes are turned into leaves, bounds the traversal stacks
+    static constexpr uint32 MAX_DEPTH = 64;
+    static constexpr uint32 NUM_BINS = 16;
+    // Ranges with fewer triangles are built serially by a single task
+    static constexpr uint32 PARALLEL_THRESHOLD = 1u << 14;
+    // Triangles handled by a single task when binning or reducing bounds in parallel
+    static constexpr uint32 BINNING_GRAIN = 1u << 14;
+    // Cost of visiting a node relative to intersecting a triangle
+    static constexpr T TRAVERSAL_COST = 1;
+
+    struct Bounds {
+        Vec3<T> min = {std::numeric_limits<T>::max(), std::numeric_limits<T>::max(), std::numeric_limits<T>::max()};
+        Vec3<T> max = {std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest()};
+
+        void grow(const Vec3<T>& p) {
+            for (uint8 i = 0; i < 3; i++) {
+                min.v[i] = std::min(min.v[i], p.v[i]);
+                max.v[i] = std::max(max.v[i], p.v[i]);
+            }
+        }
+
+        void grow(const Bounds& b) {
+            for (uint8 i = 0; i < 3; i++) {
+                min.v[i] = std::min(min.v[i], b.min.v[i]);
+                max.v[i] = std::max(max.v[i], b.max.v[i]);
+            }
+        }
+
+        T area() const {
+            const T dx = max.x - min.x, dy = max.y - min.y, dz = max.z - min.z;
+            return dx < 0 ? 0 : 2 * (dx*dy + dy*dz + dz*dx);
+        }
+    };
+
+    // Inputs of the build, indexed by source triangle
+    struct BuildData {
+        std::vector<Bounds> bounds;
+        std::vector<Vec3<T>> centroids;
+        std::vector<uint32> order;
+    };
+
+    // Triangle bounds binned along the three axes
+    struct Bins {
+        Bounds bounds[3][NUM_BINS];
+        uint32 count[3][NUM_BINS] = {};
+
+        void merge(const Bins& other) {
+            for (uint8 axis = 0; axis < 3; axis++) {
+                for (uint32 i = 0; i < NUM_BINS; i++) {
+                    bounds[axis][i].grow(other.bounds[axis][i]);
+                    count[axis][i] += other.count[axis][i];
+                }
+            }
+        }
+    };
+
+    // Subtree built by a single task into its own node array, later copied behind its placeholder node
+    struct Subtree {
+        uint32 begin, end, depth;
+        uint32 placeholder;
+        std::vector<Node> nodes;
+    };
+
+    std::vector<Node> nodes;
+    // Three vertices per triangle, in leaf order
+    std::vector<Vec3<T>> triangles;
+    // Source index of every triangle in leaf order
+    std::vector<uint32> triangleIds;
+    uint32 maxLeafSize = 4;
+
+    static const Vec3<T>& position(const Vec3<T>* positions, uint64 stride, uint32 vertex) {
+        return *reinterpret_cast<const Vec3<T>*>(reinterpret_cast<const uint8*>(positions) + vertex * stride);
+    }
+
+    static BuildData prepare(const Vec3<T>* positions, uint64 stride, const uint32* indices, uint32 numTriangles,
+                             ThreadPool* pool) {
+        BuildData data;
+        data.bounds.resize(numTriangles);
+        data.centroids.resize(numTriangles);
+        data.order.resize(numTriangles);
+
+        auto prepareRange = [&](uint64 begin, uint64 end) {
+            for (uint64 t = begin; t < end; t++) {
+                Bounds b;
+                for (uint8 k = 0; k < 3; k++) {
+                    b.grow(position(positions, stride, indices[3*t + k]));
+                }
+                data.bounds[t] = b;
+                data.centroids[t] = (b.min + b.max) * T(0.5);
+                data.order[t] = t;
+            }
+        };
+
+        if (pool != nullptr) {
+            pool->parallelFor(0, numTriangles, BINNING_GRAIN, prepareRange);
+        } else {
+            prepareRange(0, numTriangles);
+        }
+        return data;
+    }
+
+    /**
+     * Bounds of the triangles in order[begin, end) and of their centroids.
+     * Large ranges are reduced in chunks across the pool.
+     */
+    static void reduceBounds(const BuildData& data, uint32 begin, uint32 end, Bounds& bounds, Bounds& centroidBounds,
+                             ThreadPool* pool) {
+        auto reduceRange = [&data](uint64 b, uint64 e, Bounds& bounds, Bounds& centroidBounds) {
+            for (uint64 i = b; i < e; i++) {
+                bounds.grow(data.bounds[data.order[i]]);
+                centroidBounds.grow(data.centroids[data.order[i]]);
+            }
+        };
+
+        if (pool == nullptr || end - begin < 2 * BINNING_GRAIN) {
+            reduceRange(begin, end, bounds, centroidBounds);
+            return;
+        }
+
+        const uint32 numChunks = (end - begin + BINNING_GRAIN - 1) / BINNING_GRAIN;
+        std::vector<Bounds> chunkBounds(numChunks), chunkCentroids(numChunks);
+        pool->parallelFor(begin, end, BINNING_GRAIN, [&](uint64 b, uint64 e) {
+            const uint32 chunk = (b - begin) / BINNING_GRAIN;
+            reduceRange(b, e, chunkBounds[chunk], chunkCentroids[chunk]);
+        });
+        for (uint32 c = 0; c < numChunks; c++) {
+            bounds.grow(chunkBounds[c]);
+            centroidBounds.grow(chunkCentroids[c]);
+        }
+    }
+
+    static uint32 binIndex(const Vec3<T>& centroid, uint8 axis, const Bounds& centroidBounds, const T* scale) {
+        return std::min<uint32>(NUM_BINS - 1, (centroid.v[axis] - centroidBounds.min.v[axis]) * scale[axis]);
+    }
+
+    static void bin(const BuildData& data, uint32 begin, uint32 end, const Bounds& centroidBounds, Bins& bins,
+                    ThreadPool* pool) {
+        T scale[3];
+        for (uint8 axis = 0; axis < 3; axis++) {
+            const T extent = centroidBounds.max.v[axis] - centroidBounds.min.v[axis];
+            scale[axis] = extent > 0 ? NUM_BINS / extent : 0;
+        }
+
+        auto binRange = [&](uint64 b, uint64 e, Bins& bins) {
+            for (uint64 i = b; i < e; i++) {
+                const uint32 t = data.order[i];
+                for (uint8 axis = 0; axis < 3; axis++) {
+                    const uint32 k = binIndex(data.centroids[t], axis, centroidBounds, scale);
+                    bins.bounds[axis][k].grow(data.bounds[t]);
+                    bins.count[axis][k]++;
+                }
+            }
+        };
+
+        if (pool == nullptr || end - begin < 2 * BINNING_GRAIN) {
+            binRange(begin, end, bins);
+            return;
+        }
+
+        const uint32 numChunks = (end - begin + BINNING_GRAIN - 1) / BINNING_GRAIN;
+        std::vector<Bins> chunkBins(numChunks);
+        pool->parallelFor(begin, end, BINNING_GRAIN, [&](uint64 b, uint64 e) {
+            binRange(b, e, chunkBins[(b - begin) / BINNING_GRAIN]);
+        });
+        for (const Bins& b : chunkBins) {
+            bins.merge(b);
+        }
+    }
+
+    /**
+     * Best binned SAH split of order[begin, end). Returns false when the node should stay a leaf,
+     * otherwise partitions the range and sets mid.
+     */
+    bool split(BuildData& data, uint32 begin, uint32 end, const Bounds& bounds, const Bounds& centroidBounds,
+               uint32 depth, uint32& mid, ThreadPool* pool) const {
+        const uint32 count = end - begin;
+        if (count <= 1 || depth + 1 >= MAX_DEPTH) {
+            return false;
+        }
+
+        Bins bins;
+        bin(data, begin, end, centroidBounds, bins, pool);
+
+        T bestCost = std::numeric_limits<T>::max();
+        int32 bestAxis = -1;
+        uint32 bestBin = 0;
+        for (uint8 axis = 0; axis < 3; axis++) {
+            if (centroidBounds.max.v[axis] - centroidBounds.min.v[axis] <= 0) continue;
+
+            // Right side areas and counts for a split after bin i
+            T rightArea[NUM_BINS];
+            uint32 rightCount[NUM_BINS];
+            Bounds right;
+            uint32 n = 0;
+            for (uint32 i = NUM_BINS - 1; i > 0; i--) {
+                right.grow(bins.bounds[axis][i]);
+                n += bins.count[axis][i];
+                rightArea[i - 1] = right.area();
+                rightCount[i - 1] = n;
+            }
+
+            Bounds left;
+            n = 0;
+            for (uint32 i = 0; i < NUM_BINS - 1; i++) {
+                left.grow(bins.bounds[axis][i]);
+                n += bins.count[axis][i];
+                const T cost = n * left.area() + rightCount[i] * rightArea[i];
+                if (n > 0 && rightCount[i] > 0 && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = i;
+                }
+            }
+        }
+
+        const T area = bounds.area();
+        const T splitCost = TRAVERSAL_COST + (area > 0 ? bestCost / area : 0);
+        if (bestAxis >= 0 && (splitCost < count || count > maxLeafSize)) {
+            T scale[3] = {};
+            scale[bestAxis] = NUM_BINS / (centroidBounds.max.v[bestAxis] - centroidBounds.min.v[bestAxis]);
+            const auto it = std::partition(data.order.begin() + begin, data.order.begin() + end, [&](uint32 t) {
+                return binIndex(data.centroids[t], bestAxis, centroidBounds, scale) <= bestBin;
+            });
+            mid = it - data.order.begin();
+            if (mid != begin && mid != end) {
+                return true;
+            }
+        }
+
+        if (count > maxLeafSize) {
+            // Every centroid is at the same place (or binning failed to separate them), split by count
+            mid = begin + count / 2;
+            return true;
+        }
+        return false;
+    }
+
+    // Serial depth first build of order[begin, end) into out
+    uint32 buildNode(BuildData& data, uint32 begin, uint32 end, uint32 depth, std::vector<Node>& out) const {
+        const uint32 index = out.size();
+        out.emplace_back();
+
+        Bounds bounds, centroidBounds;
+        reduceBounds(data, begin, end, bounds, centroidBounds, nullptr);
+
+        uint32 mid;
+        if (split(data, begin, end, bounds, centroidBounds, depth, mid, nullptr)) {
+            buildNode(data, begin, mid, depth + 1, out);
+            const uint32 right = buildNode(data, mid, end, depth + 1, out);
+            out[index] = {bounds.min, right, bounds.max, 0};
+        } else {
+            out[index] = {bounds.min, begin, bounds.max, end - begin};
+        }
+        return index;
+    }
+
+    // Top levels of a parallel build: large ranges are split with parallel binning, small ones become subtree tasks
+    void buildTop(BuildData& data, uint32 begin, uint32 end, uint32 depth, std::vector<Subtree>& subtrees, ThreadPool& pool) {
+        const uint32 index = nodes.size();
+        nodes.emplace_back();
+
+        if (end - begin <= PARALLEL_THRESHOLD) {
+            subtrees.push_back({begin, end, depth, index, {}});
+            return;
+        }
+
+        Bounds bounds, centroidBounds;
+        reduceBounds(data, begin, end, bounds, centroidBounds, &pool);
+
+        uint32 mid;
+        if (split(data, begin, end, bounds, centroidBounds, depth, mid, &pool)) {
+            buildTop(data, begin, mid, depth + 1, subtrees, pool);
+            const uint32 right = nodes.size();
+            buildTop(data, mid, end, depth + 1, subtrees, pool);
+            nodes[index] = {bounds.min, right, bounds.max, 0};
+        } else {
+            nodes[index] = {bounds.min, begin, bounds.max, end - begin};
+        }
+    }
+
+    void build(const Vec3<T>* positions, uint64 stride, const uint32* indices, uint32 numTriangles, ThreadPool* pool) {
+        if (numTriangles == 0) return;
+
+        BuildData data = prepare(positions, stride, indices, numTriangles, pool);
+
+        if (pool == nullptr || numTriangles <= PARALLEL_THRESHOLD) {
+            nodes.reserve(2 * numTriangles);
+            buildNode(data, 0, numTriangles, 0, nodes);
+        } else {
+            std::vector<Subtree> subtrees;
+            buildTop(data, 0, numTriangles, 0, subtrees, *pool);
+
+            pool->parallelFor(0, subtrees.size(), 1, [&](uint64 begin, uint64 end) {
+                for (uint64 s = begin; s < end; s++) {
+                    Subtree& subtree = subtrees[s];
+                    subtree.nodes.reserve(2 * (subtree.end - subtree.begin));
+                    buildNode(data, subtree.begin, subtree.end, subtree.depth, subtree.nodes);
+                }
+            });
+
+            // Placeholders were created in depth first order, every subtree shifts the top nodes that follow it
+            const uint32 numTop = nodes.size();
+            std::vector<uint32> finalIndex(numTop);
+            uint32 shift = 0;
+            for (uint32 i = 0, s = 0; i < numTop; i++) {
+                finalIndex[i] = i + shift;
+                if (s < subtrees.size() && subtrees[s].placeholder == i) {
+                    shift += subtrees[s].nodes.size() - 1;
+                    s++;
+                }
+            }
+
+            std::vector<Node> top = std::move(nodes);
+            nodes = std::vector<Node>(numTop + shift);
+            for (uint32 i = 0; i < numTop; i++) {
+                Node node = top[i];
+                if (!node.isLeaf()) {
+                    node.offset = finalIndex[node.offset];
+                }
+                nodes[finalIndex[i]] = node;
+            }
+
+            pool->parallelFor(0, subtrees.size(), 1, [&](uint64 begin, uint64 end) {
+                for (uint64 s = begin; s < end; s++) {
+                    const uint32 base = finalIndex[subtrees[s].placeholder];
+                    for (uint32 i = 0; i < subtrees[s].nodes.size(); i++) {
+                        Node node = subtrees[s].nodes[i];
+                        if (!node.isLeaf()) {
+                            node.offset += base;
+                        }
+                        nodes[base + i] = node;
+                    }
+                }
+            });
+        }
+
+        triangleIds = std::move(data.order);
+        triangles.resize(static_cast<uint64>(numTriangles) * 3);
+        auto gather = [&](uint64 begin, uint64 end) {
+            for (uint64 i = begin; i < end; i++) {
+                for (uint8 k = 0; k < 3; k++) {
+                    triangles[3*i + k] = position(positions, stride, indices[3*triangleIds[i] + k]);
+                }
+            }
+        };
+        if (pool != nullptr) {
+            pool->parallelFor(0, numTriangles, BINNING_GRAIN, gather);
+        } else {
+            gather(0, numTriangles);
+        }
+    }
+
+    // Moller-Trumbore, distance along the unnormalized direction
+    static bool rayTriangle(const Vec3<T>& origin, const Vec3<T>& direction, const Vec3<T>* tri, T& t, T& u, T& v) {
+        const Vec3<T> e1 = tri[1] - tri[0], e2 = tri[2] - tri[0];
+        const Vec3<T> p = direction.cross(e2);
+        const T det = e1.dot(p);
+        if (std::abs(det) <= std::numeric_limits<T>::epsilon() * e1.length() * e2.length()) {
+            return false;
+        }
+
+        const T invDet = 1 / det;
+        const Vec3<T> s = origin - tri[0];
+        u = s.dot(p) * invDet;
+        if (u < 0 || u > 1) return false;
+
+        const Vec3<T> q = s.cross(e1);
+        v = direction.dot(q) * invDet;
+        if (v < 0 || u + v > 1) return false;
+
+        t = e2.dot(q) * invDet;
+        return t >= 0;
+    }
+
+    // Ericson, Real-Time Collision Detection 5.1.5
+    static Vec3<T> closestOnTriangle(const Vec3<T>& p, const Vec3<T>* tri) {
+        const Vec3<T>& a = tri[0];
+        const Vec3<T>& b = tri[1];
+        const Vec3<T>& c = tri[2];
+        const Vec3<T> ab = b - a, ac = c - a, ap = p - a;
+
+        const T d1 = ab.dot(ap), d2 = ac.dot(ap);
+        if (d1 <= 0 && d2 <= 0) return a;
+
+        const Vec3<T> bp = p - b;
+        const T d3 = ab.dot(bp), d4 = ac.dot(bp);
+        if (d3 >= 0 && d4 <= d3) return b;
+
+        const T vc = d1*d4 - d3*d2;
+        if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+
+        const Vec3<T> cp = p - c;
+        const T d5 = ab.dot(cp), d6 = ac.dot(cp);
+        if (d6 >= 0 && d5 <= d6) return c;
+
+        const T vb = d5*d2 - d1*d6;
+        if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+
+        const T va = d3*d6 - d5*d4;
+        if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+        const T denom = 1 / (va + vb + vc);
+        return a + ab * (vb * denom) + ac * (vc * denom);
+    }
+
+    // Separating axis test of a triangle against the box centered at the origin with the given half extents
+    static bool triangleBox(const Vec3<T>& halfExtents, const Vec3<T>& v0, const Vec3<T>& v1, const Vec3<T>& v2) {
+        const Vec3<T> e[3] = {v1 - v0, v2 - v1, v0 - v2};
+        const Vec3<T>* v[3] = {&v0, &v1, &v2};
+
+        // Cross products of the box axes with the triangle edges
+        for (uint8 i = 0; i < 3; i++) {
+            for (uint8 axis = 0; axis < 3; axis++) {
+                Vec3<T> a = {0, 0, 0};
+                const uint8 j = (axis + 1) % 3, k = (axis + 2) % 3;
+                a.v[j] = -e[i].v[k];
+                a.v[k] = e[i].v[j];
+
+                T lo = std::numeric_limits<T>::max(), hi = std::numeric_limits<T>::lowest();
+                for (uint8 n = 0; n < 3; n++) {
+                    const T p = a.dot(*v[n]);
+                    lo = std::min(lo, p);
+                    hi = std::max(hi, p);
+                }
+                const T r = halfExtents.v[j] * std::abs(a.v[j]) + halfExtents.v[k] * std::abs(a.v[k]);
+                if (lo > r || hi < -r) return false;
+            }
+        }
+
+        // Box face normals
+        for (uint8 axis = 0; axis < 3; axis++) {
+            const T lo = std::min({v0.v[axis], v1.v[axis], v2.v[axis]});
+            const T hi = std::max({v0.v[axis], v1.v[axis], v2.v[axis]});
+            if (lo > halfExtents.v[axis] || hi < -halfExtents.v[axis]) return false;
+        }
+
+        // Triangle normal
+        const Vec3<T> n = e[0].cross(e[1]);
+        const T r = halfExtents.x * std::abs(n.x) + halfExtents.y * std::abs(n.y) + halfExtents.z * std::abs(n.z);
+        return std::abs(n.dot(v0)) <= r;
+    }
+
+    static T boxDistanceSquared(const Node& node, const Vec3<T>& p) {
+        T d = 0;
+        for (uint8 i = 0; i < 3; i++) {
+            const T e = std::max({node.boundsMin.v[i] - p.v[i], T(0), p.v[i] - node.boundsMax.v[i]});
+            d += e * e;
+        }
+        return d;
+    }
+
+public:
+    Bvh() {}
+
+    /**
+     * Builds over the triangles of an indexed mesh, nodes with more than maxLeafSize triangles are always split.
+     * With a pool, the top levels are split with parallel binning and the subtrees below are built as separate tasks.
+     */
+    Bvh(const std::vector<Vertex<T>>& vertices, const std::vector<uint32>& indices, uint32 maxLeafSize = 4,
+        ThreadPool* pool = nullptr)
+    : maxLeafSize(maxLeafSize) {
+        if (vertices.empty()) return;
+        build(&vertices[0].Position, sizeof(Vertex<T>), indices.data(), indices.size() / 3, pool);
+    }
+
+    /**
+     * Builds over every mesh of a model (see Model::getNodes), with vertices transformed by the node world transforms.
+     * Triangles are numbered in node, mesh and then index order.
+     */
+    explicit Bvh(const std::vector<cglib::Node<T>>& sceneNodes, uint32 maxLeafSize = 4, ThreadPool* pool = nullptr)
+    : maxLeafSize(maxLeafSize) {
+        uint64 numVertices = 0, numIndices = 0;
+        for (const cglib::Node<T>& node : sceneNodes) {
+            for (const auto& mesh : node.meshes) {
+                numVertices += mesh.vertices.size();
+                numIndices += mesh.indices.size() / 3 * 3;
+            }
+        }
+
+        std::vector<Vec3<T>> positions(numVertices);
+        std::vector<uint32> indices;
+        indices.reserve(numIndices);
+
+        uint32 base = 0;
+        std::vector<Vec3<T>> local;
+        for (const cglib::Node<T>& node : sceneNodes) {
+            for (const auto& mesh : node.meshes) {
+                if (mesh.vertices.empty()) continue;
+
+                local.resize(mesh.vertices.size());
+                for (uint64 i = 0; i < mesh.vertices.size(); i++) {
+                    local[i] = mesh.vertices[i].Position;
+                }
+                transformPoints(node.getWorldTransform(), local.data(), &positions[base], local.size(), pool);
+
+                for (uint64 i = 0; i + 2 < mesh.indices.size(); i += 3) {
+                    indices.push_back(base + mesh.indices[i]);
+                    indices.push_back(base + mesh.indices[i + 1]);
+                    indices.push_back(base + mesh.indices[i + 2]);
+                }
+                base += mesh.vertices.size();
+            }
+        }
+
+        build(positions.data(), sizeof(Vec3<T>), indices.data(), indices.size() / 3, pool);
+    }
+
+    /**
+     * Closest intersection of origin + t * direction with t in [0, maxDistance].
+     */
+    RayHit raycast(const Vec3<T>& origin, const Vec3<T>& direction, T maxDistance = std::numeric_limits<T>::max()) const {
+        RayHit result;
+        if (nodes.empty()) return result;
+
+        const T o[4] = {origin.x, origin.y, origin.z, 0};
+        const T inv[4] = {1 / direction.x, 1 / direction.y, 1 / direction.z, 0};
+
+        T tNear;
+        if (!simd::rayBox(&nodes[0].boundsMin.x, &nodes[0].boundsMax.x, o, inv, maxDistance, tNear)) {
+            return result;
+        }
+
+        uint32 stack[MAX_DEPTH + 1];
+        uint32 size = 0;
+        uint32 index = 0;
+        while (true) {
+            const Node& node = nodes[index];
+            if (node.isLeaf()) {
+                for (uint32 i = node.offset; i < node.offset + node.count; i++) {
+                    T t, u, v;
+                    if (rayTriangle(origin, direction, &triangles[3*i], t, u, v) && t <= maxDistance) {
+                        maxDistance = t;
+                        result = {true, t, triangleIds[i], u, v};
+                    }
+                }
+            } else {
+                const uint32 left = index + 1, right = node.offset;
+                T tLeft, tRight;
+                const bool hitLeft = simd::rayBox(&nodes[left].boundsMin.x, &nodes[left].boundsMax.x, o, inv, maxDistance, tLeft);
+                const bool hitRight = simd::rayBox(&nodes[right].boundsMin.x, &nodes[right].boundsMax.x, o, inv, maxDistance, tRight);
+
+                if (hitLeft && hitRight) {
+                    // Visit the nearest child first, the other one is likely to be culled by then
+                    index = tLeft <= tRight ? left : right;
+                    stack[size++] = tLeft <= tRight ? right : left;
+                    continue;
+                }
+                if (hitLeft || hitRight) {
+                    index = hitLeft ? left : right;
+                    continue;
+                }
+            }
+
+            if (size == 0) break;
+            index = stack[--size];
+        }
+        return result;
+    }
+
+    /**
+     * Point of the mesh closest to p, only searched within maxDistance.
+     */
+    ClosestPoint closestPoint(const Vec3<T>& p, T maxDistance = std::numeric_limits<T>::max()) const {
+        ClosestPoint result;
+        if (nodes.empty()) return result;
+
+        T best = maxDistance < std::sqrt(std::numeric_limits<T>::max()) ? maxDistance * maxDistance : std::numeric_limits<T>::max();
+        uint32 stack[MAX_DEPTH + 1];
+        uint32 size = 0;
+        uint32 index = 0;
+        if (boxDistanceSquared(nodes[0], p) > best) return result;
+
+        while (true) {
+            const Node& node = nodes[index];
+            if (node.isLeaf()) {
+                for (uint32 i = node.offset; i < node.offset + node.count; i++) {
+                    const Vec3<T> q = closestOnTriangle(p, &triangles[3*i]);
+                    const Vec3<T> d = q - p;
+                    const T distance = d.dot(d);
+                    if (distance <= best) {
+                        best = distance;
+                        result.found = true;
+                        result.point = q;
+                        result.triangle = triangleIds[i];
+                    }
+                }
+            } else {
+                const uint32 left = index + 1, right = node.offset;
+                const T dLeft = boxDistanceSquared(nodes[left], p);
+                const T dRight = boxDistanceSquared(nodes[right], p);
+                const bool visitLeft = dLeft <= best, visitRight = dRight <= best;
+
+                if (visitLeft && visitRight) {
+                    index = dLeft <= dRight ? left : right;
+                    stack[size++] = dLeft <= dRight ? right : left;
+                    continue;
+                }
+                if (visitLeft || visitRight) {
+                    index = visitLeft ? left : right;
+                    continue;
+                }
+            }
+
+            // Children pushed earlier may have been outdistanced since
+            while (size > 0 && boxDistanceSquared(nodes[stack[size - 1]], p) > best) {
+                size--;
+            }
+            if (size == 0) break;
+            index = stack[--size];
+        }
+
+        if (result.found) {
+            result.distance = std::sqrt(best);
+        }
+        return result;
+    }
+
+    /**
+     * Source indices of the triangles intersecting the box [boxMin, boxMax], appended to out.
+     * Returns after the first one when firstOnly is set.
+     */
+    void overlapping(const Vec3<T>& boxMin, const Vec3<T>& boxMax, std::vector<uint32>& out, bool firstOnly = false) const {
+        if (nodes.empty()) return;
+
+        const T lo[4] = {boxMin.x, boxMin.y, boxMin.z, 0};
+        const T hi[4] = {boxMax.x, boxMax.y, boxMax.z, 0};
+        const Vec3<T> center = (boxMin + boxMax) * T(0.5);
+        const Vec3<T> halfExtents = (boxMax - boxMin) * T(0.5);
+
+        uint32 stack[MAX_DEPTH + 1];
+        uint32 size = 0;
+        stack[size++] = 0;
+        while (size > 0) {
+            const Node& node = nodes[stack[--size]];
+            if (!simd::boxOverlap(&node.boundsMin.x, &node.boundsMax.x, lo, hi)) continue;
+
+            if (node.isLeaf()) {
+                for (uint32 i = node.offset; i < node.offset + node.count; i++) {
+                    const Vec3<T>* tri = &triangles[3*i];
+                    if (triangleBox(halfExtents, tri[0] - center, tri[1] - center, tri[2] - center)) {
+                        out.push_back(triangleIds[i]);
+                        if (firstOnly) return;
+                    }
+                }
+            } else {
+                stack[size++] = node.offset;
+                stack[size++] = &node - nodes.data() + 1;
+            }
+        }
+    }
+
+    /**
+     * Whether any triangle intersects the box [boxMin, boxMax].
+     */
+    bool overlaps(const Vec3<T>& boxMin, const Vec3<T>& boxMax) const {
+        std::vector<uint32> hit;
+        overlapping(boxMin, boxMax, hit, true);
+        return !hit.empty();
+    }
+
+    const std::vector<Node>& getNodes() const {
+        return nodes;
+    }
+
+    uint32 numTriangles() const {
+        return triangleIds.size();
+    }
+};
+
+}; // namespace cglib
@@ -0,0 +1,326 @@
+#pragma once
+#include <glad/glad.h>
+#include "core_types.h"
+#include "vec3.h"
+#include "heightfield.h"
+#include "thread_pool.h"
+#include "terrain_lod.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Procedural terrain split in square chunks that are generated on worker threads around a focus point
+ * (e.g. the drone or camera position), uploaded a few per frame and evicted in least recently used order
+ * once more than maxChunks are resident. Memory usage stays flat regardless of how far the focus moves.
+ * Only a few chunks are generated at a time, the closest missing ones, and pending chunks that leave the view area
+ * are cancelled.
+ *
+ * Vertex layout matches Terrain: position at location 0 and color at location 1.
+ * Each chunk is a TerrainLod patch, so chunks far from the viewer are drawn with fewer triangles.
+ */
+class ChunkedTerrain {
+private:
+    struct ChunkData {
+        std::vector<float32> heights;
+        std::vector<float32> vertices;
+        Vec3<float32> boundsMin, boundsMax;
+    };
+
+    struct PendingChunk {
+        std::future<ChunkData> result;
+        // Set once the chunk left the view area, the job then skips it if it has not started yet
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    struct Chunk {
+        int32 cx, cz;
+        uint32 VAO = 0, VBO = 0;
+        std::vector<float32> heights;
+        Vec3<float32> boundsMin, boundsMax;
+        std::list<int64>::iterator lruPosition;
+    };
+
+    // Quads per chunk side, chunks have one more sample per side to share their borders
+    const uint32 ChunkSize;
+    const float32 SampleSpacing;
+    const int32 ViewRadius;
+    const uint32 MaxChunks;
+    const uint32 MaxUploadsPerFrame;
+    // Jobs queued or running at once, cancelled ones included until a worker gets to them
+    const uint32 MaxInFlight;
+
+    HeightfieldGenerator<float32> generator;
+    ThreadPool& pool;
+
+    // Index buffers shared by every chunk, they all have the same topology
+    TerrainLod lod;
+
+    std::unordered_map<int64, Chunk> chunks;
+    std::unordered_map<int64, PendingChunk> pending;
+
+    // Most recently used first
+    std::list<int64> lru;
+
+    static int64 key(int32 cx, int32 cz) {
+        return static_cast<int64>((static_cast<uint64>(static_cast<uint32>(cx)) << 32) | static_cast<uint32>(cz));
+    }
+
+    int32 chunkCoordinate(float32 worldCoordinate) const {
+        return static_cast<int32>(std::floor(worldCoordinate / (ChunkSize * SampleSpacing)));
+    }
+
+    static ChunkData buildChunk(const HeightfieldGenerator<float32>& generator, int32 cx, int32 cz,
+                                uint32 chunkSize, float32 spacing) {
+        const uint32 samples = chunkSize + 1;
+        const float32 x0 = static_cast<float32>(cx) * chunkSize * spacing;
+        const float32 z0 = static_cast<float32>(cz) * chunkSize * spacing;
+
+        ChunkData data;
+        data.heights.resize(static_cast<uint64>(samples) * samples);
+        generator.generateRows(data.heights.data(), samples, 0, samples, x0, z0, spacing);
+
+        const auto range = std::minmax_element(data.heights.begin(), data.heights.end());
+        const float32 minHeight = *range.first, maxHeight = *range.second;
+        const float32 skirtDepth = maxHeight - minHeight + spacing;
+        data.boundsMin = {x0, minHeight, z0};
+        data.boundsMax = {x0 + chunkSize * spacing, maxHeight, z0 + chunkSize * spacing};
+
+        // Interleaved position and color, grid first and then skirts
+        const uint32 gridVertices = samples * samples;
+        const uint32 numVertices = TerrainLod::verticesPerPatch(chunkSize);
+        data.vertices.resize(static_cast<uint64>(numVertices) * 6);
+        for (uint32 k = 0; k < numVertices; k++) {
+            uint32 i, j;
+            if (k < gridVertices) {
+                i = k / samples;
+                j = k % samples;
+            } else {
+                TerrainLod::skirtSource(chunkSize, k - gridVertices, i, j);
+            }
+
+            const float32 h = data.heights[static_cast<uint64>(i) * samples + j];
+            float32* v = &data.vertices[static_cast<uint64>(k) * 6];
+            v[0] = x0 + i * spacing;
+            v[1] = k < gridVertices ? h : h - skirtDepth;
+            v[2] = z0 + j * spacing;
+            v[3] = 0.0f;
+            v[4] = 1.0f;
+            v[5] = h <= 4*2 ? 1.0f : 0.0f;
+        }
+        return data;
+    }
+
+    void upload(int32 cx, int32 cz, ChunkData&& data) {
+        Chunk chunk;
+        chunk.cx = cx;
+        chunk.cz = cz;
+        chunk.heights = std::move(data.heights);
+        chunk.boundsMin = data.boundsMin;
+        chunk.boundsMax = data.boundsMax;
+
+        glGenVertexArrays(1, &chunk.VAO);
+        glGenBuffers(1, &chunk.VBO);
+
+        glBindVertexArray(chunk.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.VBO);
+        glBufferData(GL_ARRAY_BUFFER, data.vertices.size()*sizeof(float32), data.vertices.data(), GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float32), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float32), (void*)(3*sizeof(float32)));
+        glEnableVertexAttribArray(1);
+
+        lod.bind();
+        glBindVertexArray(0);
+
+        const int64 k = key(cx, cz);
+        lru.push_front(k);
+        chunk.lruPosition = lru.begin();
+        chunks.emplace(k, std::move(chunk));
+    }
+
+    void release(Chunk& chunk) {
+        glDeleteVertexArrays(1, &chunk.VAO);
+        glDeleteBuffers(1, &chunk.VBO);
+    }
+
+public:
+    /**
+     * chunkSize: quads per chunk side, sampleSpacing: world distance between samples,
+     * viewRadius: chunks kept around the focus in each direction,
+     * maxChunks: resident chunk budget, raised to the view area if smaller.
+     * A power of two chunkSize gives the most levels of detail, 0 is raised to 1.
+     */
+    ChunkedTerrain(uint32 chunkSize, float32 sampleSpacing, uint32 viewRadius, uint32 maxChunks,
+                   const HeightfieldGenerator<float32>& generator, uint32 maxUploadsPerFrame = 2,
+                   ThreadPool& pool = ThreadPool::global())
+    : ChunkSize(std::max(chunkSize, 1u)), SampleSpacing(sampleSpacing), ViewRadius(viewRadius),
+      MaxChunks(std::max(maxChunks, (2*viewRadius + 1) * (2*viewRadius + 1))),
+      MaxUploadsPerFrame(maxUploadsPerFrame), MaxInFlight(2 * std::max(1u, pool.size())),
+      generator(generator), pool(pool), lod(ChunkSize) {}
+
+    ~ChunkedTerrain() {
+        // Let the workers finish before the GL resources go away, their results are simply dropped
+        for (auto& p : pending) {
+            p.second.cancelled->store(true);
+        }
+        for (auto& p : pending) {
+            p.second.result.wait();
+        }
+        for (auto& c : chunks) {
+            release(c.second);
+        }
+    }
+
+    ChunkedTerrain(const ChunkedTerrain&) = delete;
+    ChunkedTerrain& operator=(const ChunkedTerrain&) = delete;
+
+    /**
+     * Must be called on the GL thread once per frame.
+     * Schedules missing chunks around focus (closest first), uploads finished ones and evicts the least recently used.
+     */
+    void update(const Vec3<float32>& focus) {
+        const int32 fx = chunkCoordinate(focus.x);
+        const int32 fz = chunkCoordinate(focus.z);
+        auto inView = [&](int32 cx, int32 cz) {
+            return std::abs(cx - fx) <= ViewRadius && std::abs(cz - fz) <= ViewRadius;
+        };
+
+        // Cancel the chunks the focus moved away from, so the workers move on to the ones around it.
+        // Chunks back in view before their job started are generated after all.
+        for (auto& p : pending) {
+            const bool cancel = !inView(static_cast<int32>(p.first >> 32), static_cast<int32>(p.first & 0xFFFFFFFF));
+            p.second.cancelled->store(cancel);
+        }
+
+        // Visit the view area from the center outwards
+        std::vector<std::pair<int32, int32>> wanted;
+        for (int32 dx = -ViewRadius; dx <= ViewRadius; dx++) {
+            for (int32 dz = -ViewRadius; dz <= ViewRadius; dz++) {
+                wanted.emplace_back(fx + dx, fz + dz);
+            }
+        }
+        std::sort(wanted.begin(), wanted.end(), [fx, fz](const std::pair<int32, int32>& a, const std::pair<int32, int32>& b) {
+            const int64 da = static_cast<int64>(a.first - fx)*(a.first - fx) + static_cast<int64>(a.second - fz)*(a.second - fz);
+            const int64 db = static_cast<int64>(b.first - fx)*(b.first - fx) + static_cast<int64>(b.second - fz)*(b.second - fz);
+            return da < db;
+        });
+
+        // Touch resident chunks from the farthest so that the closest end up at the front
+        for (auto it = wanted.rbegin(); it != wanted.rend(); it++) {
+            auto resident = chunks.find(key(it->first, it->second));
+            if (resident != chunks.end()) {
+                lru.splice(lru.begin(), lru, resident->second.lruPosition);
+            }
+        }
+
+        // Schedule missing chunks from the closest, a few at a time so that later frames can still pick closer ones
+        for (auto c = wanted.begin(); c != wanted.end() && pending.size() < MaxInFlight; c++) {
+            const int32 cx = c->first, cz = c->second;
+            const int64 k = key(cx, cz);
+            if (chunks.find(k) == chunks.end() && pending.find(k) == pending.end()) {
+                const HeightfieldGenerator<float32> gen = generator;
+                const uint32 size = ChunkSize;
+                const float32 spacing = SampleSpacing;
+                auto cancelled = std::make_shared<std::atomic<bool>>(false);
+                PendingChunk chunk;
+                chunk.cancelled = cancelled;
+                chunk.result = pool.submit([gen, cx, cz, size, spacing, cancelled] {
+                    return cancelled->load() ? ChunkData() : buildChunk(gen, cx, cz, size, spacing);
+                });
+                pending.emplace(k, std::move(chunk));
+            }
+        }
+
+        // Upload finished chunks. Cancelled ones, and the ones the focus moved away from in the meantime, are dropped
+        // (a skipped chunk back in view is scheduled again next frame).
+        uint32 uploads = 0;
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (it->second.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                it++;
+                continue;
+            }
+
+            const int32 cx = static_cast<int32>(it->first >> 32);
+            const int32 cz = static_cast<int32>(it->first & 0xFFFFFFFF);
+            const bool wanted = !it->second.cancelled->load() && inView(cx, cz);
+            if (wanted && uploads == MaxUploadsPerFrame) {
+                it++;
+                continue;
+            }
+
+            ChunkData data = it->second.result.get();
+            it = pending.erase(it);
+            if (wanted && !data.heights.empty()) {
+                upload(cx, cz, std::move(data));
+                uploads++;
+            }
+        }
+
+        while (chunks.size() > MaxChunks) {
+            auto victim = chunks.find(lru.back());
+            release(victim->second);
+            chunks.erase(victim);
+            lru.pop_back();
+        }
+    }
+
+    /**
+     * Draws every resident chunk at full resolution.
+     */
+    void draw() {
+        for (auto& c : chunks) {
+            glBindVertexArray(c.second.VAO);
+            lod.draw(0, 0);
+        }
+        glBindVertexArray(0);
+    }
+
+    /**
+     * Draws every resident chunk at the level of detail matching its on screen size as seen from viewPosition.
+     */
+    void draw(const Vec3<float32>& viewPosition, const Mat4<float32>& projection, float32 viewportHeight) {
+        for (auto& c : chunks) {
+            glBindVertexArray(c.second.VAO);
+            lod.draw(lod.selectLevel(viewPosition, c.second.boundsMin, c.second.boundsMax, SampleSpacing, projection, viewportHeight), 0);
+        }
+        glBindVertexArray(0);
+    }
+
+    /**
+     * Height of the sample at or below (x, z), 0 if its chunk is not resident.
+     */
+    float32 getHeight(float32 x, float32 z) const {
+        const int32 cx = chunkCoordinate(x);
+        const int32 cz = chunkCoordinate(z);
+        auto it = chunks.find(key(cx, cz));
+        if (it == chunks.end()) {
+            return 0;
+        }
+
+        const float32 chunkExtent = ChunkSize * SampleSpacing;
+        const uint32 i = std::min<uint32>(ChunkSize, (x - cx * chunkExtent) / SampleSpacing);
+        const uint32 j = std::min<uint32>(ChunkSize, (z - cz * chunkExtent) / SampleSpacing);
+        return it->second.heights[static_cast<uint64>(i) * (ChunkSize + 1) + j];
+    }
+
+    uint32 numResidentChunks() const {
+        return chunks.size();
+    }
+
+    uint32 numPendingChunks() const {
+        return pending.size();
+    }
+};
+
+}; // namespace cglib
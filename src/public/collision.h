@@ -6,6 +6,10 @@
 #include "mat4.h"
 #include "vec3.h"
 #include "core_types.h"
+#include "height_grid.h"
+#include "height_pyramid.h"
+#include <algorithm>
+#include <array>
 #include <cmath>
 
 namespace cglib {
@@ -64,6 +68,26 @@ public:
                 (-0.5f * scale) + y, (0.5f * scale) + y,
                 (-0.5f * scale) + z, (0.5f * scale) + z};
     }
+
+    /**
+     * Bounds enclosing the box at every point of the segment from -> to, laid out like getUpdatedBounds.
+     */
+    static std::array<T, 6> getSweptBounds(const Vec3<T>& from, const Vec3<T>& to, const T scale) {
+        const T half = 0.5f * scale;
+
+        return {std::min(from.x, to.x) - half, std::max(from.x, to.x) + half,
+                std::min(from.y, to.y) - half, std::max(from.y, to.y) + half,
+                std::min(from.z, to.z) - half, std::max(from.z, to.z) + half};
+    }
+};
+
+template <typename T = float32>
+struct SweepResult {
+    bool hit = false;
+    // Fraction of the movement that can be done without touching the terrain
+    T time = 1;
+    // Terrain normal at the contact, only meaningful on hit
+    Vec3<T> normal = {0, 1, 0};
 };
 
 template <typename T = float32>
@@ -76,7 +100,61 @@ private:
     const uint32 WIDTH = 1001;
     const uint32 HEIGHT = 1001;
 
-    std::vector<std::vector<T>> height;
+    // Smallest sweep tolerance in world units, smaller ones (including non-positive) are raised to it
+    static constexpr float32 MIN_SWEEP_TOLERANCE = 1.0f / 1024;
+
+    HeightGrid<T> height;
+    HeightPyramid<T> heightPyramid;
+
+    // Boxes that are not strictly inside the grid never collide
+    bool inside(const std::array<T, 6>& bounds) const {
+        return std::floor(bounds[0]) > 0 && std::floor(bounds[1]) < WIDTH &&
+               std::floor(bounds[4]) > 0 && std::floor(bounds[5]) < HEIGHT;
+    }
+
+    // Whether the terrain under the bounds reaches their bottom, only the grid samples they cover count
+    bool overlaps(const std::array<T, 6>& bounds) const {
+        return heightPyramid.anyAtLeast(std::floor(bounds[0]), std::floor(bounds[4]),
+                                        std::floor(bounds[1]), std::floor(bounds[5]), bounds[2]);
+    }
+
+    // Same rule as hasCollided
+    bool touches(const Vec3<T>& position, const T scale) const {
+        const std::array<T, 6> bounds = BoundingBox<T>::getSweptBounds(position, position, scale);
+        return inside(bounds) && overlaps(bounds);
+    }
+
+    // Earliest hit in [t0, t1], reported at the start of the span no longer than minSpan it was found in
+    bool sweep(const Vec3<T>& from, const Vec3<T>& delta, const T scale, T t0, T t1, T minSpan, SweepResult<T>& result) const {
+        if (!overlaps(BoundingBox<T>::getSweptBounds(from + t0 * delta, from + t1 * delta, scale))) {
+            return false;
+        }
+
+        // Short enough spans are reported as is, grazing contacts thinner than the tolerance are not missed.
+        // Spans that can no longer be halved (adjacent times on long movements) stop here too.
+        const T tm = (t0 + t1) / 2;
+        if (t1 - t0 <= minSpan || tm <= t0 || tm >= t1) {
+            if (!inside(BoundingBox<T>::getSweptBounds(from + t1 * delta, from + t1 * delta, scale))) {
+                return false;
+            }
+            result.hit = true;
+            result.time = t0;
+            result.normal = contactNormal(from + t1 * delta, scale);
+            return true;
+        }
+
+        return sweep(from, delta, scale, t0, tm, minSpan, result) || sweep(from, delta, scale, tm, t1, minSpan, result);
+    }
+
+    // Normal of the grid at the highest sample under the box
+    Vec3<T> contactNormal(const Vec3<T>& position, const T scale) const {
+        const std::array<T, 6> bounds = BoundingBox<T>::getSweptBounds(position, position, scale);
+        int64 x = std::floor(position.x), z = std::floor(position.z);
+        heightPyramid.maxInRegion(std::floor(bounds[0]), std::floor(bounds[4]), std::floor(bounds[1]), std::floor(bounds[5]), x, z);
+
+        Vec3<T> normal = {(height.at(x - 1, z) - height.at(x + 1, z)) / 2, 1, (height.at(x, z - 1) - height.at(x, z + 1)) / 2};
+        return normal.normalize();
+    }
 
 public:
     CollisionDetector(Model<T>& drone, Model<T>& terrain) : drone(drone), terrain(terrain) {
@@ -86,19 +164,20 @@ public:
 
     void createTerrainGrid() {
         std::vector<Node<T>>& nodes = terrain.getNodes();
-        height = std::vector<std::vector<T>>(WIDTH, std::vector<T>(HEIGHT, 0.));
+        height = HeightGrid<T>(WIDTH, HEIGHT, 0, HeightGridLayout::TILED);
 
         for (uint32 i = 0; i < nodes.size(); i++) {
             for (uint32 j = 0; j < nodes[i].meshes.size(); j++) {
                 for (uint32 k = 0; k < nodes[i].meshes[j].vertices.size(); k++) {
-                    Vec3<T>& v = nodes[i].meshes[j].vertices[k].Position;
+                    const Vec3<T>& v = nodes[i].meshes[j].vertices[k].Position;
                     int32 x = std::floor(v.x);
                     int32 z = std::floor(v.z + HEIGHT - 1);
-                    height[x][z] = std::max(v.y, height[x][z]);
+                    height(x, z) = std::max(v.y, height(x, z));
                 }
             }
         }
 
+        heightPyramid.build(height);
     }
 
     void setupDebug() {
@@ -121,26 +200,50 @@ public:
         glBindVertexArray(0);
     }
 
-    bool hasCollided(const Vec3<T>& dronePosition, const T scale) {
-        std::vector<T> bounds = BoundingBox<T>::getUpdatedBounds(dronePosition, scale);
-        int32 xMin = std::floor(bounds[0]);
-        int32 xMax = std::floor(bounds[1]);
-        int32 zMin = std::floor(bounds[4]);
-        int32 zMax = std::floor(bounds[5]);
-        float32 yMin = bounds[2];
+    /**
+     * Terrain height below the world position (x, z), interpolated between the grid samples.
+     */
+    T getHeight(T x, T z) const {
+        return height.bilinear(x, z);
+    }
 
-        bool inside = xMin > 0 && xMax < WIDTH && zMin > 0 && zMax < HEIGHT;
+    const HeightGrid<T>& getHeightGrid() const {
+        return height;
+    }
 
-        if (!inside) return false;
+    const HeightPyramid<T>& getHeightPyramid() const {
+        return heightPyramid;
+    }
 
-        for (int32 i = xMin; i <= xMax; i++) {
-            for (int32 j = zMin; j <= zMax; j++) {
-                if (height[i][j] >= yMin) {
-                    return true;
-                }
-            }
+    bool hasCollided(const Vec3<T>& dronePosition, const T scale) {
+        return touches(dronePosition, scale);
+    }
+
+    /**
+     * Moves the box of size scale from `from` to `to` and reports the first contact with the terrain.
+     * The path is halved recursively and a half is skipped as soon as the terrain under its swept bounds
+     * is below the lowest bottom of the box, so only the spans close to the terrain are refined,
+     * down to tolerance world units (at least MIN_SWEEP_TOLERANCE). The reported time is conservative: it may
+     * come early by up to a grid sample, but unlike testing the end position thin ridges cannot be skipped over.
+     * Contacts follow hasCollided, boxes that are not strictly inside the grid pass freely.
+     */
+    SweepResult<T> sweep(const Vec3<T>& from, const Vec3<T>& to, const T scale, const T tolerance = 0.125f) const {
+        SweepResult<T> result;
+        if (touches(from, scale)) {
+            result.hit = true;
+            result.time = 0;
+            result.normal = contactNormal(from, scale);
+            return result;
+        }
+
+        const Vec3<T> delta = to - from;
+        const T length = delta.length();
+        if (length == 0) {
+            return result;
         }
-        return false;
+
+        sweep(from, delta, scale, 0, 1, std::max<T>(tolerance, MIN_SWEEP_TOLERANCE) / length, result);
+        return result;
     }
 
 };
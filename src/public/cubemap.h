@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include "shader_program.h"
+#include "texture_cache.h"
 
 namespace cglib {
 
@@ -52,6 +53,7 @@ class CubeMap {
     };
 
 private:
+    TextureCache::Handle texture;
     uint32 textureId;
     uint32 VAO, VBO;
     std::vector<std::string> faces;
@@ -63,36 +65,9 @@ private:
             std::string back, std::string front)
             :
             faces {right, left, top, bottom, back, front} {
-                glGenTextures(1, &textureId);
-                glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
-
-                int32 width, height, nrChannels;
-                for (uint32 i = 0; i < faces.size(); i++)
-                {
-                    ubyte *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-                    if (data)
-                    {
-                        GLenum format;
-                        if (nrChannels == 1)
-                            format = GL_RED;
-                        else if (nrChannels == 3)
-                            format = GL_RGB;
-                        else if (nrChannels == 4)
-                            format = GL_RGBA;
-                        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-                        stbi_image_free(data);
-                    }
-                    else
-                    {
-                        std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-                        stbi_image_free(data);
-                    }
-                }
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+                // Decoded in the background, the faces show a placeholder until TextureLoader::processCompleted
+                texture = TextureCache::global().cubeMap(faces);
+                textureId = *texture;
 
                 setupBuffers();
             }
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "core_types.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace cglib {
+
+enum class HeightGridLayout {
+    // x-major rows, (x, z) is at x * depth + z
+    ROW_MAJOR,
+    // 8x8 tiles stored contiguously, neighbouring samples along both axes share cache lines
+    TILED
+};
+
+/**
+ * Heights sampled on a regular grid, width samples along x and depth along z, in a single contiguous buffer.
+ * Integer accessors address samples directly, the sampling functions take coordinates in sample units
+ * and clamp them to the grid.
+ */
+template <typename T = float32>
+class HeightGrid {
+private:
+    static constexpr uint32 TILE_BITS = 3;
+    static constexpr uint32 TILE_MASK = (1u << TILE_BITS) - 1;
+
+    uint32 width = 0, depth = 0;
+    uint32 tilesPerRow = 0;
+    HeightGridLayout layout = HeightGridLayout::ROW_MAJOR;
+    std::vector<T> data;
+
+    uint64 storageSize() const {
+        if (layout == HeightGridLayout::ROW_MAJOR) {
+            return static_cast<uint64>(width) * depth;
+        }
+        const uint64 tileRows = (width + TILE_MASK) >> TILE_BITS;
+        return (tileRows * tilesPerRow) << (2 * TILE_BITS);
+    }
+
+    // Catmull-Rom spline through p0..p3, evaluated between p1 and p2
+    static T cubic(T p0, T p1, T p2, T p3, T t) {
+        return p1 + 0.5f * t * (p2 - p0 + t * (2*p0 - 5*p1 + 4*p2 - p3 + t * (3*(p1 - p2) + p3 - p0)));
+    }
+
+public:
+    HeightGrid() {}
+
+    HeightGrid(uint32 width, uint32 depth, T value = 0, HeightGridLayout layout = HeightGridLayout::ROW_MAJOR)
+    : width(width), depth(depth), tilesPerRow((depth + TILE_MASK) >> TILE_BITS), layout(layout) {
+        data = std::vector<T>(storageSize(), value);
+    }
+
+    /**
+     * Takes ownership of width * depth heights in row-major order (as produced by HeightfieldGenerator).
+     */
+    HeightGrid(uint32 width, uint32 depth, std::vector<T>&& rowMajor, HeightGridLayout layout = HeightGridLayout::ROW_MAJOR)
+    : width(width), depth(depth), tilesPerRow((depth + TILE_MASK) >> TILE_BITS), layout(layout) {
+        if (layout == HeightGridLayout::ROW_MAJOR) {
+            data = std::move(rowMajor);
+            return;
+        }
+
+        data = std::vector<T>(storageSize());
+        for (uint32 x = 0; x < width; x++) {
+            for (uint32 z = 0; z < depth; z++) {
+                data[index(x, z)] = rowMajor[static_cast<uint64>(x) * depth + z];
+            }
+        }
+    }
+
+    uint64 index(uint32 x, uint32 z) const {
+        if (layout == HeightGridLayout::ROW_MAJOR) {
+            return static_cast<uint64>(x) * depth + z;
+        }
+        const uint64 tile = static_cast<uint64>(x >> TILE_BITS) * tilesPerRow + (z >> TILE_BITS);
+        return (tile << (2 * TILE_BITS)) + ((x & TILE_MASK) << TILE_BITS) + (z & TILE_MASK);
+    }
+
+    T& operator()(uint32 x, uint32 z) {
+        return data[index(x, z)];
+    }
+
+    T operator()(uint32 x, uint32 z) const {
+        return data[index(x, z)];
+    }
+
+    /**
+     * Sample at (x, z) clamped to the grid.
+     */
+    T at(int64 x, int64 z) const {
+        x = std::clamp<int64>(x, 0, static_cast<int64>(width) - 1);
+        z = std::clamp<int64>(z, 0, static_cast<int64>(depth) - 1);
+        return data[index(x, z)];
+    }
+
+    bool contains(int64 x, int64 z) const {
+        return x >= 0 && x < static_cast<int64>(width) && z >= 0 && z < static_cast<int64>(depth);
+    }
+
+    T bilinear(T x, T z) const {
+        const T fx = std::floor(x), fz = std::floor(z);
+        const int64 ix = static_cast<int64>(fx), iz = static_cast<int64>(fz);
+        const T tx = std::clamp<T>(x - fx, 0, 1), tz = std::clamp<T>(z - fz, 0, 1);
+
+        const T h00 = at(ix, iz), h01 = at(ix, iz + 1);
+        const T h10 = at(ix + 1, iz), h11 = at(ix + 1, iz + 1);
+
+        const T h0 = h00 + tz * (h01 - h00);
+        const T h1 = h10 + tz * (h11 - h10);
+        return h0 + tx * (h1 - h0);
+    }
+
+    T bicubic(T x, T z) const {
+        const T fx = std::floor(x), fz = std::floor(z);
+        const int64 ix = static_cast<int64>(fx), iz = static_cast<int64>(fz);
+        const T tx = x - fx, tz = z - fz;
+
+        T rows[4];
+        for (int64 i = 0; i < 4; i++) {
+            rows[i] = cubic(at(ix + i - 1, iz - 1), at(ix + i - 1, iz), at(ix + i - 1, iz + 1), at(ix + i - 1, iz + 2), tz);
+        }
+        return cubic(rows[0], rows[1], rows[2], rows[3], tx);
+    }
+
+    void bilinear(const T* xs, const T* zs, T* out, uint64 n) const {
+        for (uint64 i = 0; i < n; i++) {
+            out[i] = bilinear(xs[i], zs[i]);
+        }
+    }
+
+    void bicubic(const T* xs, const T* zs, T* out, uint64 n) const {
+        for (uint64 i = 0; i < n; i++) {
+            out[i] = bicubic(xs[i], zs[i]);
+        }
+    }
+
+    uint32 getWidth() const {
+        return width;
+    }
+
+    uint32 getDepth() const {
+        return depth;
+    }
+
+    HeightGridLayout getLayout() const {
+        return layout;
+    }
+};
+
+}; // namespace cglib
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "core_types.h"
+#include "height_grid.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Min/max mip pyramid over a HeightGrid. Cell (x, z) of level l covers the 2^l x 2^l samples starting at
+ * (x << l, z << l); level 0 is the grid itself and the last level is a single cell.
+ * Region queries stop at the coarsest cells that are enough to decide, so their cost grows with the
+ * perimeter of the region instead of its area.
+ */
+template <typename T = float32>
+class HeightPyramid {
+private:
+    std::vector<HeightGrid<T>> maxLevels;
+    std::vector<HeightGrid<T>> minLevels;
+
+    // Whether some sample in [xMin, xMax] x [zMin, zMax] (clipped to the cell) is at least y
+    bool anyAtLeast(uint32 level, uint32 x, uint32 z, int64 xMin, int64 zMin, int64 xMax, int64 zMax, T y) const {
+        const int64 cellMinX = static_cast<int64>(x) << level, cellMaxX = ((static_cast<int64>(x) + 1) << level) - 1;
+        const int64 cellMinZ = static_cast<int64>(z) << level, cellMaxZ = ((static_cast<int64>(z) + 1) << level) - 1;
+
+        if (cellMaxX < xMin || cellMinX > xMax || cellMaxZ < zMin || cellMinZ > zMax) return false;
+        if (maxLevels[level](x, z) < y) return false;
+
+        // Every sample of the cell is high enough, and at least one lies in the region
+        if (minLevels[level](x, z) >= y) return true;
+
+        const bool inside = cellMinX >= xMin && cellMaxX <= xMax && cellMinZ >= zMin && cellMaxZ <= zMax;
+        if (inside) return true;
+
+        const uint32 child = level - 1;
+        const uint32 cx = x << 1, cz = z << 1;
+        for (uint32 i = cx; i < std::min(cx + 2, maxLevels[child].getWidth()); i++) {
+            for (uint32 j = cz; j < std::min(cz + 2, maxLevels[child].getDepth()); j++) {
+                if (anyAtLeast(child, i, j, xMin, zMin, xMax, zMax, y)) return true;
+            }
+        }
+        return false;
+    }
+
+    T maxInRegion(uint32 level, uint32 x, uint32 z, int64 xMin, int64 zMin, int64 xMax, int64 zMax, T best,
+                  int64& bestX, int64& bestZ) const {
+        const int64 cellMinX = static_cast<int64>(x) << level, cellMaxX = ((static_cast<int64>(x) + 1) << level) - 1;
+        const int64 cellMinZ = static_cast<int64>(z) << level, cellMaxZ = ((static_cast<int64>(z) + 1) << level) - 1;
+
+        if (cellMaxX < xMin || cellMinX > xMax || cellMaxZ < zMin || cellMinZ > zMax) return best;
+        if (maxLevels[level](x, z) <= best) return best;
+
+        const bool inside = cellMinX >= xMin && cellMaxX <= xMax && cellMinZ >= zMin && cellMaxZ <= zMax;
+        if (inside || level == 0) {
+            locateMax(level, x, z, bestX, bestZ);
+            return maxLevels[level](x, z);
+        }
+
+        const uint32 child = level - 1;
+        const uint32 cx = x << 1, cz = z << 1;
+        for (uint32 i = cx; i < std::min(cx + 2, maxLevels[child].getWidth()); i++) {
+            for (uint32 j = cz; j < std::min(cz + 2, maxLevels[child].getDepth()); j++) {
+                best = maxInRegion(child, i, j, xMin, zMin, xMax, zMax, best, bestX, bestZ);
+            }
+        }
+        return best;
+    }
+
+    // Intersects the region with the grid, false if nothing is left. Cells along the edge of the coarser levels
+    // extend past the grid and repeat its edge samples there, unclipped regions would find heights that do not exist.
+    bool clip(int64& xMin, int64& zMin, int64& xMax, int64& zMax) const {
+        if (maxLevels.empty()) return false;
+        xMin = std::max<int64>(xMin, 0);
+        zMin = std::max<int64>(zMin, 0);
+        xMax = std::min<int64>(xMax, static_cast<int64>(maxLevels[0].getWidth()) - 1);
+        zMax = std::min<int64>(zMax, static_cast<int64>(maxLevels[0].getDepth()) - 1);
+        return xMin <= xMax && zMin <= zMax;
+    }
+
+    // Follows the children holding the maximum of a cell down to the sample
+    void locateMax(uint32 level, uint32 x, uint32 z, int64& sampleX, int64& sampleZ) const {
+        const T value = maxLevels[level](x, z);
+        while (level > 0) {
+            level--;
+            const uint32 cx = x << 1, cz = z << 1;
+            for (uint32 i = cx; i < std::min(cx + 2, maxLevels[level].getWidth()); i++) {
+                for (uint32 j = cz; j < std::min(cz + 2, maxLevels[level].getDepth()); j++) {
+                    if (maxLevels[level](i, j) == value) {
+                        x = i;
+                        z = j;
+                    }
+                }
+            }
+        }
+        sampleX = x;
+        sampleZ = z;
+    }
+
+public:
+    HeightPyramid() {}
+
+    explicit HeightPyramid(const HeightGrid<T>& grid) {
+        build(grid);
+    }
+
+    /**
+     * Rebuilds every level, to be called after the grid changes.
+     */
+    void build(const HeightGrid<T>& grid) {
+        maxLevels.clear();
+        minLevels.clear();
+        maxLevels.push_back(grid);
+        minLevels.push_back(grid);
+
+        while (maxLevels.back().getWidth() > 1 || maxLevels.back().getDepth() > 1) {
+            const HeightGrid<T>& maxPrev = maxLevels.back();
+            const HeightGrid<T>& minPrev = minLevels.back();
+            const uint32 w = (maxPrev.getWidth() + 1) / 2, d = (maxPrev.getDepth() + 1) / 2;
+
+            HeightGrid<T> maxLevel(w, d, 0, grid.getLayout());
+            HeightGrid<T> minLevel(w, d, 0, grid.getLayout());
+            for (uint32 x = 0; x < w; x++) {
+                for (uint32 z = 0; z < d; z++) {
+                    // Clamped reads repeat the last row/column for odd sizes, which does not change min/max
+                    const uint32 px = x << 1, pz = z << 1;
+                    maxLevel(x, z) = std::max({maxPrev.at(px, pz), maxPrev.at(px + 1, pz),
+                                               maxPrev.at(px, pz + 1), maxPrev.at(px + 1, pz + 1)});
+                    minLevel(x, z) = std::min({minPrev.at(px, pz), minPrev.at(px + 1, pz),
+                                               minPrev.at(px, pz + 1), minPrev.at(px + 1, pz + 1)});
+                }
+            }
+
+            maxLevels.push_back(std::move(maxLevel));
+            minLevels.push_back(std::move(minLevel));
+        }
+    }
+
+    /**
+     * Whether any sample in the inclusive region [xMin, xMax] x [zMin, zMax] has height >= y.
+     * Only the part of the region inside the grid is searched.
+     */
+    bool anyAtLeast(int64 xMin, int64 zMin, int64 xMax, int64 zMax, T y) const {
+        if (!clip(xMin, zMin, xMax, zMax)) return false;
+        return anyAtLeast(maxLevels.size() - 1, 0, 0, xMin, zMin, xMax, zMax, y);
+    }
+
+    /**
+     * Highest sample in the inclusive region [xMin, xMax] x [zMin, zMax], lowest if the region has no sample
+     * inside the grid.
+     */
+    T maxInRegion(int64 xMin, int64 zMin, int64 xMax, int64 zMax) const {
+        int64 x, z;
+        return maxInRegion(xMin, zMin, xMax, zMax, x, z);
+    }
+
+    /**
+     * Same as above, also returning where the highest sample is (left untouched if the region is empty).
+     */
+    T maxInRegion(int64 xMin, int64 zMin, int64 xMax, int64 zMax, int64& x, int64& z) const {
+        const T lowest = std::numeric_limits<T>::lowest();
+        if (!clip(xMin, zMin, xMax, zMax)) return lowest;
+        return maxInRegion(maxLevels.size() - 1, 0, 0, xMin, zMin, xMax, zMax, lowest, x, z);
+    }
+
+    uint32 numLevels() const {
+        return maxLevels.size();
+    }
+
+    const HeightGrid<T>& maxLevel(uint32 level) const {
+        return maxLevels[level];
+    }
+
+    const HeightGrid<T>& minLevel(uint32 level) const {
+        return minLevels[level];
+    }
+};
+
+}; // namespace cglib
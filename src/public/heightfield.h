@@ -0,0 +1,71 @@
+#pragma once
+
+#include "core_types.h"
+#include "perlin.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Generates heights from PerlinNoise::noiseOctaves.
+ * The sample at world position (x, z) has height amplitude * noiseOctaves(x / noiseScale, z / noiseScale, 0, ...).
+ * Buffers are contiguous and row-major: rows advance along x, columns along z.
+ * No GL calls are made, so generation can run on any thread.
+ */
+template <typename T = float32>
+class HeightfieldGenerator {
+private:
+    T noiseScale;
+    T amplitude;
+    uint16 numOctaves;
+    T persistence;
+    T lacunarity;
+
+    // Rows handled by a single task
+    static constexpr uint32 ROWS_PER_TASK = 8;
+
+public:
+    HeightfieldGenerator(T noiseScale, T amplitude, uint16 numOctaves, T persistence, T lacunarity)
+    : noiseScale(noiseScale), amplitude(amplitude), numOctaves(numOctaves), persistence(persistence), lacunarity(lacunarity) {}
+
+    /**
+     * Fills rows [rowBegin, rowEnd) of a rows x cols tile whose first sample is at (x0, z0)
+     * and whose samples are step apart. out points to the start of the whole tile.
+     */
+    void generateRows(T* out, uint32 cols, uint32 rowBegin, uint32 rowEnd, T x0, T z0, T step) const {
+        std::vector<T> xs(cols), zs(cols), zeros(cols, T(0));
+        for (uint32 j = 0; j < cols; j++) {
+            zs[j] = (z0 + j * step) / noiseScale;
+        }
+
+        for (uint32 i = rowBegin; i < rowEnd; i++) {
+            std::fill(xs.begin(), xs.end(), (x0 + i * step) / noiseScale);
+
+            T* row = out + static_cast<uint64>(i) * cols;
+            PerlinNoise<T>::noiseOctaves(xs.data(), zs.data(), zeros.data(), row, cols, numOctaves, persistence, lacunarity);
+            for (uint32 j = 0; j < cols; j++) {
+                row[j] *= amplitude;
+            }
+        }
+    }
+
+    /**
+     * Fills a rows x cols tile, splitting it in bands of rows across the pool.
+     */
+    void generate(T* out, uint32 rows, uint32 cols, T x0, T z0, T step, ThreadPool& pool = ThreadPool::global()) const {
+        pool.parallelFor(0, rows, ROWS_PER_TASK, [&](uint64 begin, uint64 end) {
+            generateRows(out, cols, begin, end, x0, z0, step);
+        });
+    }
+
+    std::vector<T> generate(uint32 rows, uint32 cols, T x0, T z0, T step, ThreadPool& pool = ThreadPool::global()) const {
+        std::vector<T> heights(static_cast<uint64>(rows) * cols);
+        generate(heights.data(), rows, cols, x0, z0, step, pool);
+        return heights;
+    }
+};
+
+}; // namespace cglib
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "core_types.h"
+#include "mat3.h"
+#include "mat4.h"
+
+namespace cglib {
+
+/**
+ * Per instance vertex attributes of Mesh::drawInstanced.
+ * Matrices are stored column major, the layout GLSL expects for mat4 and mat3 attributes.
+ */
+struct InstanceData {
+    float32 model[16];
+    float32 normalMatrix[9];
+
+    // Attribute locations of the first column of each matrix, followed by the other columns
+    static constexpr uint32 MODEL_LOCATION = 4;
+    static constexpr uint32 NORMAL_MATRIX_LOCATION = 8;
+
+    InstanceData() {}
+
+    template <typename T>
+    InstanceData(const Mat4<T>& m, const Mat3<T>& n) {
+        for (uint32 row = 0; row < 4; row++) {
+            for (uint32 col = 0; col < 4; col++) {
+                model[col * 4 + row] = static_cast<float32>(m.v[row * 4 + col]);
+            }
+        }
+        for (uint32 row = 0; row < 3; row++) {
+            for (uint32 col = 0; col < 3; col++) {
+                normalMatrix[col * 3 + row] = static_cast<float32>(n.v[row * 3 + col]);
+            }
+        }
+    }
+};
+
+}; // namespace cglib
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "core_types.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+
+namespace cglib {
+
+/**
+ * Read-only memory mapping of a whole file, unmapped on destruction.
+ * The mapping is page aligned, so any offset aligned in the file is aligned in memory too.
+ */
+class MappedFile {
+private:
+    const uint8* data = nullptr;
+    uint64 size = 0;
+
+public:
+    MappedFile() {}
+
+    explicit MappedFile(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                data = static_cast<const uint8*>(mapping);
+                size = info.st_size;
+            }
+        }
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data != nullptr) {
+            ::munmap(const_cast<uint8*>(data), size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept : data(other.data), size(other.size) {
+        other.data = nullptr;
+        other.size = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+        return *this;
+    }
+
+    bool isOpen() const {
+        return data != nullptr;
+    }
+
+    const uint8* getData() const {
+        return data;
+    }
+
+    uint64 getSize() const {
+        return size;
+    }
+
+    /**
+     * Asks the kernel to read the whole file ahead, so that later accesses do not fault page by page.
+     */
+    void prefetch() const {
+        if (data != nullptr) {
+            ::madvise(const_cast<uint8*>(data), size, MADV_WILLNEED);
+        }
+    }
+
+    /**
+     * Size and modification time (seconds) of a file, false if it cannot be accessed.
+     */
+    static bool stamp(const std::string& path, uint64& size, int64& mtime) {
+        struct stat info;
+        if (::stat(path.c_str(), &info) != 0) return false;
+        size = info.st_size;
+        mtime = info.st_mtime;
+        return true;
+    }
+};
+
+}; // namespace cglib
@@ -46,7 +46,18 @@ struct Mat3 {
         return &v[0];
     }
 
-    Mat3<T> transposedInverse() {
+    const T* getPtr() const {
+        return &v[0];
+    }
+
+    bool equals(const Mat3<T>& other) const {
+        for (uint8 i = 0; i < 9; i++) {
+            if (v[i] != other.v[i]) return false;
+        }
+        return true;
+    }
+
+    Mat3<T> transposedInverse() const {
         T determinant = x0*(y1*z2 - y2*z1) - y0*(x1*z2 - z1*x2) + z0*(x1*y2 - y1*x2);
         T invdet = 1/determinant;
 
@@ -5,11 +5,14 @@
 #include <iostream>
 #include "vec4.h"
 #include "mat3.h"
+#include "simd.h"
 
 namespace cglib {
 
+// Rows are aligned to a full vector register (16 bytes for float32, 32 bytes for float64)
+// so that the simd kernels can load them directly.
 template <typename T = float32>
-struct Mat4 {
+struct alignas(4 * sizeof(T)) Mat4 {
 
     union {
         struct {
@@ -22,6 +25,8 @@ struct Mat4 {
         T v[16];
     };
 
+    Mat4() {}
+
     Mat4(const std::initializer_list<std::initializer_list<T>>& l) {
         uint8 i = 0;
         for (auto& row : l) {
@@ -49,6 +54,10 @@ struct Mat4 {
         return &v[0];
     }
 
+    const T* getPtr() const {
+        return &v[0];
+    }
+
     Mat4<T>& operator+=(T s) {
         x0 += s; y0 += s; z0 += s; w0 += s;
         x1 += s; y1 += s; z1 += s; w1 += s;
@@ -205,32 +214,36 @@ struct Mat4 {
     }
 
     Mat4<T> dot(const Mat4<T>& other) const {
-        return {
-            {
-                x0*other.x0 + y0*other.x1 + z0*other.x2 + w0*other.x3,
-                x0*other.y0 + y0*other.y1 + z0*other.y2 + w0*other.y3,
-                x0*other.z0 + y0*other.z1 + z0*other.z2 + w0*other.z3,
-                x0*other.w0 + y0*other.w1 + z0*other.w2 + w0*other.w3
-            },
-            {
-                x1*other.x0 + y1*other.x1 + z1*other.x2 + w1*other.x3,
-                x1*other.y0 + y1*other.y1 + z1*other.y2 + w1*other.y3,
-                x1*other.z0 + y1*other.z1 + z1*other.z2 + w1*other.z3,
-                x1*other.w0 + y1*other.w1 + z1*other.w2 + w1*other.w3
-            },
-            {
-                x2*other.x0 + y2*other.x1 + z2*other.x2 + w2*other.x3,
-                x2*other.y0 + y2*other.y1 + z2*other.y2 + w2*other.y3,
-                x2*other.z0 + y2*other.z1 + z2*other.z2 + w2*other.z3,
-                x2*other.w0 + y2*other.w1 + z2*other.w2 + w2*other.w3
-            },
-            {
-                x3*other.x0 + y3*other.x1 + z3*other.x2 + w3*other.x3,
-                x3*other.y0 + y3*other.y1 + z3*other.y2 + w3*other.y3,
-                x3*other.z0 + y3*other.z1 + z3*other.z2 + w3*other.z3,
-                x3*other.w0 + y3*other.w1 + z3*other.w2 + w3*other.w3
-            }
-        };
+        Mat4<T> result;
+        simd::mat4Dot(v, other.v, result.v);
+        return result;
+    }
+
+    /**
+     * General inverse. The matrix must be invertible.
+     */
+    Mat4<T> inverse() const {
+        Mat4<T> result;
+        simd::mat4Inverse(v, result.v);
+        return result;
+    }
+
+    /**
+     * Inverse of an affine transformation (rotation, scale, shear and translation).
+     */
+    Mat4<T> affineInverse() const {
+        Mat4<T> result;
+        simd::mat4AffineInverse(v, result.v);
+        return result;
+    }
+
+    /**
+     * Inverse of a rigid body transformation (rotation and translation only).
+     */
+    Mat4<T> rigidInverse() const {
+        Mat4<T> result;
+        simd::mat4RigidInverse(v, result.v);
+        return result;
     }
 
     Mat3<T> mat3() const {
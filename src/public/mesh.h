@@ -7,16 +7,23 @@
 #include "vec2.h"
 #include "core_types.h"
 #include "texture_loader.h"
+#include "texture_cache.h"
 
 #include "vertex.h"
 #include "texture.h"
+#include "span.h"
+#include "instance_data.h"
 #include "node.h"
 #include "model.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
+#include <utility>
 #include <vector>
 
 namespace cglib {
@@ -24,18 +31,44 @@ template <typename T = float32>
 class Mesh {
 public:
     uint32 VAO, VBO, EBO;
-    std::vector<Vertex<T>> vertices;
-    std::vector<uint32> indices;
+    // Views into storage, which is either the vectors the mesh was built from or a memory mapped file.
+    // Copies of a mesh share the same storage.
+    Span<const Vertex<T>> vertices;
+    Span<const uint32> indices;
+    std::shared_ptr<const void> storage;
     std::vector<Texture> textures;
 
     Node<T>* node;
     Mesh<T>* parent = nullptr;
     std::string name;
 
+    // Per instance attributes of drawInstanced, created on first use
+    uint32 instanceVBO = 0;
+    uint64 instanceCapacity = 0;
+
 public:
+    /**
+     * Takes ownership of the vertex and index buffers, pass them with std::move to avoid a copy.
+     */
     Mesh(Node<T>* node, std::string name, std::vector<Vertex<T>> vertices, std::vector<uint32> indices, std::vector<Texture> textures)
     :
-    node(node), name(name), vertices{vertices}, indices{indices}, textures{textures}
+    textures{textures}, node(node), name(name)
+    {
+        auto owned = std::make_shared<std::pair<std::vector<Vertex<T>>, std::vector<uint32>>>(std::move(vertices), std::move(indices));
+        this->vertices = owned->first;
+        this->indices = owned->second;
+        storage = std::move(owned);
+        setupMesh();
+    }
+
+    /**
+     * Uses vertices and indices in place, e.g. straight from a memory mapped file.
+     * storage must keep them alive, it is released with the last copy of the mesh.
+     */
+    Mesh(Node<T>* node, std::string name, Span<const Vertex<T>> vertices, Span<const uint32> indices, std::vector<Texture> textures,
+         std::shared_ptr<const void> storage)
+    :
+    vertices(vertices), indices(indices), storage(std::move(storage)), textures{textures}, node(node), name(name)
     {
         setupMesh();
     }
@@ -58,10 +91,10 @@ public:
 
         glBindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex<T>), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex<T>), vertices.data(), GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
         // Set vertex attribute pointers
         glEnableVertexAttribArray(0);
@@ -84,13 +117,14 @@ public:
 
     /**
      * Add a texture. Can be used to add textures after model loading.
+     * The image is shared through the TextureCache and decoded in the background.
      */
     void addTexture(const std::string& type, std::string path) {
-        Texture texture {
-            TextureLoader::textureFromFile(path),
-            type,
-            path.substr(path.find_last_of('/')+1, path.size())
-        };
+        Texture texture;
+        texture.handle = TextureCache::global().texture(path, TextureLoader::placeholderFor(type), type == "texture_normal");
+        texture.id = *texture.handle;
+        texture.type = type;
+        texture.path = path.substr(path.find_last_of('/')+1, path.size());
         textures.push_back(texture);
     }
 
@@ -98,7 +132,22 @@ public:
      * Draw the mesh
      */
     void draw(const ShaderProgram& shaderProgram, const Mat4<T>& projection, const Mat4<T>& view) const {
-        // Bind textures
+        bindTextures(shaderProgram);
+        setTransform(shaderProgram, projection, view, node->getWorldTransform(), node->normalMatrix());
+
+        glBindVertexArray(VAO);
+        drawElements();
+        glBindVertexArray(0);
+
+        // Reset
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /**
+     * Uses shaderProgram and binds the textures to the texture_<type>N samplers.
+     * With setTransform and drawElements (VAO bound) the mesh can be drawn several times at different places.
+     */
+    void bindTextures(const ShaderProgram& shaderProgram) const {
         uint32 diffuseNr  = 1;
         uint32 specularNr = 1;
         uint32 normalNr   = 1;
@@ -124,21 +173,76 @@ public:
             shaderProgram.setInt(textureType + number, i);
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
+    }
 
-        // Set model
-        shaderProgram.setMat4("model", node->model);
-        shaderProgram.setMat3("normalMatrix", node->model.mat3().transposedInverse());
-        shaderProgram.setMat4("modelViewProjection", projection.dot(view.dot(node->model)));
+    void setTransform(const ShaderProgram& shaderProgram, const Mat4<T>& projection, const Mat4<T>& view,
+                      const Mat4<T>& model, const Mat3<T>& normalMatrix) const {
+        shaderProgram.setMat4("model", model);
+        shaderProgram.setMat3("normalMatrix", normalMatrix);
+        shaderProgram.setMat4("modelViewProjection", projection.dot(view.dot(model)));
+    }
 
-        // Draw mesh
-        glBindVertexArray(VAO);
+    void drawElements() const {
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    }
+
+    /**
+     * Draws the mesh once per instance with a single glDrawElementsInstanced.
+     * The instances are uploaded to the mesh's instance buffer and read by the shader from the attributes at
+     * InstanceData::MODEL_LOCATION and NORMAL_MATRIX_LOCATION when its "instanced" uniform is set,
+     * instead of the model and normalMatrix uniforms (see project/shaders/drone/vertex.glsl).
+     */
+    void drawInstanced(const ShaderProgram& shaderProgram, const Mat4<T>& projection, const Mat4<T>& view,
+                       Span<const InstanceData> instances) {
+        if (instances.empty()) return;
+
+        bindTextures(shaderProgram);
+        shaderProgram.setBool("instanced", true);
+        shaderProgram.setMat4("viewProjection", projection.dot(view));
+
+        glBindVertexArray(VAO);
+        uploadInstances(instances);
+        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instances.size());
         glBindVertexArray(0);
 
         // Reset
+        shaderProgram.setBool("instanced", false);
         glActiveTexture(GL_TEXTURE0);
     }
 
+    /**
+     * Fills the instance buffer and points the instance attributes of the bound VAO at it.
+     * The pointers are set on every call, copies of the mesh share the VAO but not the buffer.
+     */
+    void uploadInstances(Span<const InstanceData> instances) {
+        if (instanceVBO == 0) {
+            glGenBuffers(1, &instanceVBO);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+        // Orphaned every frame so the driver does not wait for the draws still reading the previous data
+        const uint64 size = instances.size() * sizeof(InstanceData);
+        instanceCapacity = std::max(instanceCapacity, size);
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances.data());
+
+        for (uint32 i = 0; i < 4; i++) {
+            const uint32 location = InstanceData::MODEL_LOCATION + i;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, model) + i * 4 * sizeof(float32)));
+            glVertexAttribDivisor(location, 1);
+        }
+        for (uint32 i = 0; i < 3; i++) {
+            const uint32 location = InstanceData::NORMAL_MATRIX_LOCATION + i;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, normalMatrix) + i * 3 * sizeof(float32)));
+            glVertexAttribDivisor(location, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
     void print() const {
         std::cout << "----------------------------------------------" << std::endl;
         std::cout << "Mesh: " << name << std::endl;
@@ -0,0 +1,415 @@
+#pragma once
+
+#include "core_types.h"
+#include "vertex.h"
+#include "texture.h"
+#include "mapped_file.h"
+#include "span.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cglib {
+
+template <typename T>
+struct Node;
+
+template <typename T>
+class Mesh;
+
+/**
+ * Binary snapshot of the nodes and meshes of a Model, so that later runs can skip the importer.
+ *
+ * Layout: Header, SourceRecord[numSources], NodeRecord[numNodes], MeshRecord[numMeshes], TextureRecord[numTextures],
+ * the string table, then the vertex and index arrays of every mesh, each aligned to DATA_ALIGNMENT.
+ * Nodes are stored in depth first order, textures as (type, path) references that are loaded again on read.
+ * The sources are the model file followed by the files it depends on (e.g. the MTL libraries of an OBJ),
+ * dependencies are stored relative to the directory of the model file.
+ * A cache is used only if it has the current VERSION and vertex size, and if every source still has
+ * the recorded size and modification time, or else the recorded content hash. Missing sources do not invalidate it,
+ * except for dependencies that did not exist when the cache was written.
+ */
+template <typename T = float32>
+class MeshCache {
+public:
+    // Bump whenever the layout below or Vertex changes
+    static constexpr uint32 VERSION = 3;
+
+    using LoadTexture = std::function<Texture(const std::string& type, const std::string& path)>;
+
+private:
+    static constexpr char MAGIC[4] = {'C', 'G', 'M', 'C'};
+    static constexpr uint64 DATA_ALIGNMENT = 16;
+    static constexpr uint32 NO_PARENT = 0xFFFFFFFF;
+    // Recorded size of a dependency that did not exist
+    static constexpr uint64 MISSING_SOURCE = 0xFFFFFFFFFFFFFFFFull;
+
+    struct StringRef {
+        uint32 offset, length;
+    };
+
+    struct Header {
+        char magic[4];
+        uint32 version;
+        uint32 vertexSize;
+        uint32 numNodes, numMeshes, numTextures;
+        uint32 numSources;
+        uint32 padding;
+        uint64 stringsOffset, stringsSize;
+    };
+
+    struct SourceRecord {
+        StringRef path;
+        uint64 size;
+        int64 mtime;
+        uint64 hash;
+    };
+
+    // Every record is a multiple of 8 bytes so that the tables after it stay aligned
+    struct NodeRecord {
+        StringRef name;
+        uint32 parent;
+        uint32 firstMesh, numMeshes;
+        uint32 padding;
+    };
+
+    struct MeshRecord {
+        StringRef name;
+        uint32 firstTexture, numTextures;
+        uint64 vertexOffset, numVertices;
+        uint64 indexOffset, numIndices;
+    };
+
+    struct TextureRecord {
+        StringRef type, path;
+    };
+
+    static_assert(sizeof(Header) % 8 == 0 && sizeof(SourceRecord) % 8 == 0 && sizeof(NodeRecord) % 8 == 0 &&
+                  sizeof(MeshRecord) % 8 == 0, "Misaligned cache records");
+
+    static uint64 align(uint64 offset) {
+        return (offset + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+    }
+
+    static StringRef addString(std::string& strings, const std::string& s) {
+        const StringRef ref = {static_cast<uint32>(strings.size()), static_cast<uint32>(s.size())};
+        strings += s;
+        return ref;
+    }
+
+    static std::string getString(const uint8* strings, const StringRef& ref) {
+        return std::string(reinterpret_cast<const char*>(strings) + ref.offset, ref.length);
+    }
+
+    template <typename R>
+    static const R* records(const uint8* data, uint64 offset) {
+        return reinterpret_cast<const R*>(data + offset);
+    }
+
+    static std::string directoryOf(const std::string& path) {
+        return path.substr(0, path.find_last_of('/'));
+    }
+
+    // Whether count elements of elementSize bytes starting at offset end before limit, without overflowing
+    static bool fits(uint64 offset, uint64 count, uint64 elementSize, uint64 limit) {
+        return offset <= limit && count <= (limit - offset) / elementSize;
+    }
+
+    static uint64 tablesSize(const Header& header) {
+        return sizeof(Header) + static_cast<uint64>(header.numSources) * sizeof(SourceRecord) +
+               static_cast<uint64>(header.numNodes) * sizeof(NodeRecord) + static_cast<uint64>(header.numMeshes) * sizeof(MeshRecord) +
+               static_cast<uint64>(header.numTextures) * sizeof(TextureRecord);
+    }
+
+    static bool stamp(const std::string& path, SourceRecord& record) {
+        if (!MappedFile::stamp(path, record.size, record.mtime)) return false;
+        const MappedFile source(path);
+        record.hash = hash(source.getData(), source.getSize());
+        return true;
+    }
+
+    /**
+     * Whether every table, string and array of the cache lies inside the file and every record refers to existing
+     * entries, so that load never reads out of bounds. Truncated or corrupted files are treated as stale.
+     */
+    static bool isConsistent(const MappedFile& cache) {
+        const uint8* data = cache.getData();
+        const uint64 size = cache.getSize();
+        const Header& header = *records<Header>(data, 0);
+
+        // The counts are 32 bit, so the table size cannot overflow
+        if (header.numSources == 0 || tablesSize(header) > size || header.stringsOffset < tablesSize(header) ||
+            !fits(header.stringsOffset, header.stringsSize, 1, size)) {
+            return false;
+        }
+        auto validString = [&](const StringRef& ref) {
+            return fits(ref.offset, ref.length, 1, header.stringsSize);
+        };
+
+        const SourceRecord* sourceRecords = records<SourceRecord>(data, sizeof(Header));
+        const uint64 nodesOffset = sizeof(Header) + header.numSources * sizeof(SourceRecord);
+        const uint64 meshesOffset = nodesOffset + header.numNodes * sizeof(NodeRecord);
+        const NodeRecord* nodeRecords = records<NodeRecord>(data, nodesOffset);
+        const MeshRecord* meshRecords = records<MeshRecord>(data, meshesOffset);
+        const TextureRecord* textureRecords = records<TextureRecord>(data, meshesOffset + header.numMeshes * sizeof(MeshRecord));
+
+        for (uint32 i = 0; i < header.numSources; i++) {
+            if (!validString(sourceRecords[i].path)) return false;
+        }
+
+        for (uint32 i = 0; i < header.numNodes; i++) {
+            const NodeRecord& node = nodeRecords[i];
+            // Parents come first in depth first order, which also rules out cycles
+            if (!validString(node.name) || (node.parent != NO_PARENT && node.parent >= i) ||
+                !fits(node.firstMesh, node.numMeshes, 1, header.numMeshes)) {
+                return false;
+            }
+        }
+
+        for (uint32 i = 0; i < header.numTextures; i++) {
+            if (!validString(textureRecords[i].type) || !validString(textureRecords[i].path)) return false;
+        }
+
+        const uint64 dataBegin = header.stringsOffset + header.stringsSize;
+        for (uint32 j = 0; j < header.numMeshes; j++) {
+            const MeshRecord& m = meshRecords[j];
+            if (!validString(m.name) || !fits(m.firstTexture, m.numTextures, 1, header.numTextures) ||
+                m.vertexOffset < dataBegin || m.vertexOffset % alignof(Vertex<T>) != 0 ||
+                !fits(m.vertexOffset, m.numVertices, sizeof(Vertex<T>), size) ||
+                m.indexOffset < dataBegin || m.indexOffset % alignof(uint32) != 0 ||
+                !fits(m.indexOffset, m.numIndices, sizeof(uint32), size)) {
+                return false;
+            }
+
+            // Indices are followed blindly by the BVH and the GPU
+            const uint32* indices = records<uint32>(data, m.indexOffset);
+            for (uint64 k = 0; k < m.numIndices; k++) {
+                if (indices[k] >= m.numVertices) return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    static std::string cachePath(const std::string& sourcePath) {
+        return sourcePath + ".cgmesh";
+    }
+
+    /**
+     * 64 bit FNV-1a over 8 byte words, the tail is hashed bytewise.
+     */
+    static uint64 hash(const uint8* data, uint64 size) {
+        uint64 h = 0xcbf29ce484222325ull;
+        uint64 i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64 word;
+            std::memcpy(&word, data + i, 8);
+            h = (h ^ word) * 0x100000001b3ull;
+        }
+        for (; i < size; i++) {
+            h = (h ^ data[i]) * 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    /**
+     * Writes nodes (as built by Model) to cachePath. The file is written next to its final location
+     * and renamed at the end, so concurrent readers never see a partial cache.
+     * dependencies are the other files the nodes were built from, a change to any of them invalidates the cache.
+     */
+    static bool write(const std::string& cachePath, const std::string& sourcePath, const std::vector<Node<T>>& nodes,
+                      const std::vector<std::string>& dependencies = {}) {
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, 4);
+        header.version = VERSION;
+        header.vertexSize = sizeof(Vertex<T>);
+        header.numNodes = nodes.size();
+        header.numSources = dependencies.size() + 1;
+
+        std::string strings;
+        std::vector<SourceRecord> sourceRecords(header.numSources);
+        sourceRecords[0].path = addString(strings, sourcePath.substr(sourcePath.find_last_of('/') + 1));
+        if (!stamp(sourcePath, sourceRecords[0])) return false;
+
+        const std::string directory = directoryOf(sourcePath) + '/';
+        for (uint32 i = 0; i < dependencies.size(); i++) {
+            const std::string& dependency = dependencies[i];
+            const bool relative = dependency.compare(0, directory.size(), directory) == 0;
+            SourceRecord& record = sourceRecords[i + 1];
+            record.path = addString(strings, relative ? dependency.substr(directory.size()) : dependency);
+            if (!stamp(dependency, record)) {
+                record.size = MISSING_SOURCE;
+            }
+        }
+
+        std::vector<NodeRecord> nodeRecords(nodes.size());
+        std::vector<MeshRecord> meshRecords;
+        std::vector<TextureRecord> textureRecords;
+        std::vector<const Mesh<T>*> meshes;
+
+        for (uint32 i = 0; i < nodes.size(); i++) {
+            nodeRecords[i].parent = NO_PARENT;
+        }
+        for (uint32 i = 0; i < nodes.size(); i++) {
+            for (const Node<T>* child : nodes[i].children) {
+                nodeRecords[child - nodes.data()].parent = i;
+            }
+        }
+
+        for (uint32 i = 0; i < nodes.size(); i++) {
+            NodeRecord& record = nodeRecords[i];
+            record.name = addString(strings, nodes[i].name);
+            record.firstMesh = meshRecords.size();
+            record.numMeshes = nodes[i].meshes.size();
+
+            for (const Mesh<T>& mesh : nodes[i].meshes) {
+                MeshRecord m = {};
+                m.name = addString(strings, mesh.name);
+                m.firstTexture = textureRecords.size();
+                m.numTextures = mesh.textures.size();
+                m.numVertices = mesh.vertices.size();
+                m.numIndices = mesh.indices.size();
+                for (const Texture& texture : mesh.textures) {
+                    textureRecords.push_back({addString(strings, texture.type), addString(strings, texture.path)});
+                }
+                meshRecords.push_back(m);
+                meshes.push_back(&mesh);
+            }
+        }
+
+        header.numMeshes = meshRecords.size();
+        header.numTextures = textureRecords.size();
+        header.stringsOffset = tablesSize(header);
+        header.stringsSize = strings.size();
+
+        uint64 offset = header.stringsOffset + header.stringsSize;
+        for (MeshRecord& m : meshRecords) {
+            m.vertexOffset = align(offset);
+            m.indexOffset = align(m.vertexOffset + m.numVertices * sizeof(Vertex<T>));
+            offset = m.indexOffset + m.numIndices * sizeof(uint32);
+        }
+
+        const std::string temporaryPath = cachePath + ".tmp";
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(reinterpret_cast<const char*>(sourceRecords.data()), sourceRecords.size() * sizeof(SourceRecord));
+        file.write(reinterpret_cast<const char*>(nodeRecords.data()), nodeRecords.size() * sizeof(NodeRecord));
+        file.write(reinterpret_cast<const char*>(meshRecords.data()), meshRecords.size() * sizeof(MeshRecord));
+        file.write(reinterpret_cast<const char*>(textureRecords.data()), textureRecords.size() * sizeof(TextureRecord));
+        file.write(strings.data(), strings.size());
+
+        const char padding[DATA_ALIGNMENT] = {};
+        uint64 position = header.stringsOffset + header.stringsSize;
+        for (uint32 i = 0; i < meshRecords.size(); i++) {
+            const MeshRecord& m = meshRecords[i];
+            file.write(padding, m.vertexOffset - position);
+            file.write(reinterpret_cast<const char*>(meshes[i]->vertices.data()), m.numVertices * sizeof(Vertex<T>));
+            position = m.vertexOffset + m.numVertices * sizeof(Vertex<T>);
+
+            file.write(padding, m.indexOffset - position);
+            file.write(reinterpret_cast<const char*>(meshes[i]->indices.data()), m.numIndices * sizeof(uint32));
+            position = m.indexOffset + m.numIndices * sizeof(uint32);
+        }
+
+        file.close();
+        if (!file) {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        return std::rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+    }
+
+    /**
+     * Whether the cache is intact and matches the current source file and its dependencies.
+     */
+    static bool isValid(const MappedFile& cache, const std::string& sourcePath) {
+        if (!cache.isOpen() || cache.getSize() < sizeof(Header)) return false;
+
+        const Header& header = *records<Header>(cache.getData(), 0);
+        if (std::memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION || header.vertexSize != sizeof(Vertex<T>) ||
+            !isConsistent(cache)) {
+            return false;
+        }
+
+        const SourceRecord* sourceRecords = records<SourceRecord>(cache.getData(), sizeof(Header));
+        const uint8* strings = cache.getData() + header.stringsOffset;
+        for (uint32 i = 0; i < header.numSources; i++) {
+            const SourceRecord& record = sourceRecords[i];
+            std::string path = sourcePath;
+            if (i > 0) {
+                path = getString(strings, record.path);
+                if (path.empty() || path[0] != '/') path = directoryOf(sourcePath) + '/' + path;
+            }
+
+            uint64 size;
+            int64 mtime;
+            if (!MappedFile::stamp(path, size, mtime)) continue;
+            if (record.size == MISSING_SOURCE || size != record.size) return false;
+            if (mtime == record.mtime) continue;
+
+            // Touched or copied, only the content matters
+            const MappedFile source(path);
+            if (hash(source.getData(), source.getSize()) != record.hash) return false;
+        }
+        return true;
+    }
+
+    /**
+     * Rebuilds the nodes and meshes stored at cachePath, textures are created through loadTexture.
+     * Meshes point directly into the mapping, which stays open as long as any of them is alive.
+     * Returns false (leaving nodes untouched) if the cache is missing or stale.
+     */
+    static bool load(const std::string& cachePath, const std::string& sourcePath, std::vector<Node<T>>& nodes,
+                     const LoadTexture& loadTexture) {
+        // Shared by every mesh, the vertex and index data are used in place
+        const std::shared_ptr<const MappedFile> mapping = std::make_shared<const MappedFile>(cachePath);
+        const MappedFile& cache = *mapping;
+        if (!isValid(cache, sourcePath)) return false;
+
+        // Every record was bounds checked by isValid
+        const uint8* data = cache.getData();
+        const Header& header = *records<Header>(data, 0);
+        const uint64 nodesOffset = sizeof(Header) + header.numSources * sizeof(SourceRecord);
+        const uint64 meshesOffset = nodesOffset + header.numNodes * sizeof(NodeRecord);
+        const NodeRecord* nodeRecords = records<NodeRecord>(data, nodesOffset);
+        const MeshRecord* meshRecords = records<MeshRecord>(data, meshesOffset);
+        const TextureRecord* textureRecords = records<TextureRecord>(data, meshesOffset + header.numMeshes * sizeof(MeshRecord));
+        const uint8* strings = data + header.stringsOffset;
+
+        nodes = std::vector<Node<T>>(header.numNodes);
+        for (uint32 i = 0; i < header.numNodes; i++) {
+            const NodeRecord& record = nodeRecords[i];
+            Node<T>& node = nodes[i];
+            node.name = getString(strings, record.name);
+
+            for (uint32 j = record.firstMesh; j < record.firstMesh + record.numMeshes; j++) {
+                const MeshRecord& m = meshRecords[j];
+                const Vertex<T>* vertices = records<Vertex<T>>(data, m.vertexOffset);
+                const uint32* indices = records<uint32>(data, m.indexOffset);
+
+                std::vector<Texture> textures;
+                for (uint32 k = m.firstTexture; k < m.firstTexture + m.numTextures; k++) {
+                    textures.push_back(loadTexture(getString(strings, textureRecords[k].type), getString(strings, textureRecords[k].path)));
+                }
+
+                node.meshes.push_back(Mesh<T>(&node, getString(strings, m.name), Span<const Vertex<T>>(vertices, m.numVertices),
+                                              Span<const uint32>(indices, m.numIndices), textures, mapping));
+            }
+
+            // Depth first order keeps the children in their original order
+            if (record.parent != NO_PARENT) {
+                nodes[record.parent].children.push_back(&node);
+            }
+        }
+        return true;
+    }
+};
+
+}; // namespace cglib
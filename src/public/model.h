@@ -8,12 +8,20 @@
 #include <mesh.h>
 #include <shader_program.h>
 #include "texture_loader.h"
+#include "texture_cache.h"
+#include "mesh_cache.h"
+#include "name_table.h"
+#include "obj_loader.h"
+#include "thread_pool.h"
+#include "transform_hierarchy.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <unordered_map>
+#include <utility>
 
 namespace cglib {
 
@@ -22,16 +30,35 @@ class Model
 {
 private:
     std::vector<Node<T>> nodes;
+    TransformHierarchy<T> transforms;
+    // Interned node name -> index in nodes, the first node of each name
+    std::unordered_map<uint32, uint32> nodeIndices;
+    // Incremented every time nodes are (re)loaded
+    uint32 generation = 0;
+    std::string path;
     std::string directory;
+
+    // Vertex and index data of an aiMesh, converted off the GL thread
+    struct MeshData {
+        std::vector<Vertex<T>> vertices;
+        std::vector<uint32> indices;
+        // Nodes still referencing the mesh, the last one takes the data
+        uint32 uses = 0;
+    };
 public:
-    explicit Model(std::string&& path)
+    /**
+     * useCache: load from (and write) the binary MeshCache next to the file instead of importing it every time.
+     */
+    explicit Model(std::string&& path, bool useCache = true)
     {
-        loadModel(path);
+        loadModel(path, useCache);
     }
 
     // Draw all the model's meshes
     void draw(const ShaderProgram& shaderProgram, const Mat4<T>& projection, const Mat4<T>& view)
     {
+        updateModelMatrices();
+
         for (uint32 i = 0; i < nodes.size(); i++) {
             for(uint32 j = 0; j < nodes[i].meshes.size(); j++) {
                 nodes[i].meshes[j].draw(shaderProgram, projection, view);
@@ -39,27 +66,148 @@ public:
         }
     }
 
-    void _updateModelMatrices(Node<T>* root, const Mat4<T>& curr) {
-        const Mat4<T> model = curr.dot(root->model);
-        root->model = model;
+    /**
+     * Brings the world transforms up to date with the local transforms set since the last call.
+     * Large hierarchies are updated across the pool. Returns the number of recomputed nodes.
+     */
+    uint32 updateModelMatrices(ThreadPool& pool = ThreadPool::global()) {
+        return transforms.update(&pool);
+    }
+
+    void setLocalTransform(uint32 node, const Mat4<T>& local) {
+        nodes[node].setLocalTransform(local);
+    }
 
-        for (uint32 i = 0; i < root->children.size(); i++) {
-            _updateModelMatrices(root->children[i], model);
+    /**
+     * Ignored if the model has no node with the name of handle.
+     */
+    void setLocalTransform(NodeHandle handle, const Mat4<T>& local) {
+        if (Node<T>* node = getNode(handle)) {
+            node->setLocalTransform(local);
         }
     }
 
-    void updateModelMatrices() {
-        _updateModelMatrices(&nodes[0], Mat4<T>::identity());
+    const Mat4<T>& getLocalTransform(uint32 node) const {
+        return nodes[node].getLocalTransform();
     }
 
-    void resetModelMatrices() {
+    const Mat4<T>& getWorldTransform(uint32 node) const {
+        return nodes[node].getWorldTransform();
+    }
+
+    TransformHierarchy<T>& getTransforms() {
+        return transforms;
+    }
+
+    uint32 getGeneration() const {
+        return generation;
+    }
+
+    /**
+     * Loads path again, e.g. after it changed on disk. NodeHandles stay valid and the local transforms
+     * of the nodes that still exist are kept.
+     */
+    void reload(bool useCache = true) {
+        loadModel(std::string(path), useCache);
+    }
+
+    // Loads a support assimp extension from file, OBJ files are read by ObjLoader instead.
+    void loadModel(const std::string &path, bool useCache = true) {
+        this->path = path;
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // Local transforms of the current nodes, by name
+        std::vector<std::pair<NodeHandle, Mat4<T>>> locals;
+        for (const Node<T>& node : nodes) {
+            if (node.transforms != nullptr) {
+                locals.push_back({NodeHandle(node.name), node.getLocalTransform()});
+            }
+        }
+
+        if (!loadNodes(path, useCache)) {
+            return;
+        }
+
+        buildTransforms();
+        indexNodes();
+        generation++;
+        for (const auto& local : locals) {
+            setLocalTransform(local.first, local.second);
+        }
+    }
+
+    bool loadNodes(const std::string& path, bool useCache) {
+        const std::string cachePath = MeshCache<T>::cachePath(path);
+
+        // Textures shared by several meshes are loaded once by the TextureCache
+        auto loadTextureOnce = [this](const std::string& type, const std::string& texturePath) {
+            return loadTexture(type, texturePath);
+        };
+
+        if (useCache && MeshCache<T>::load(cachePath, path, nodes, loadTextureOnce)) {
+            return true;
+        }
+
+        // Files other than path the nodes are built from
+        std::vector<std::string> dependencies;
+        const std::string extension = path.substr(path.find_last_of('.') + 1);
+        if (extension == "obj" || extension == "OBJ") {
+            if (!ObjLoader<T>::load(path, nodes, loadTextureOnce, &dependencies)) {
+                std::cout << "ERROR::OBJ:: could not read " << path << std::endl;
+                return false;
+            }
+        } else if (!importModel(path)) {
+            return false;
+        }
+
+        if (useCache && !MeshCache<T>::write(cachePath, path, nodes, dependencies)) {
+            std::cout << "WARNING::MESH_CACHE:: could not write " << cachePath << std::endl;
+        }
+        return true;
+    }
+
+    void indexNodes() {
+        nodeIndices.clear();
+        nodeIndices.reserve(nodes.size());
         for (uint32 i = 0; i < nodes.size(); i++) {
-            nodes[i].model = Mat4<T>::identity();
+            nodeIndices.emplace(NameTable::intern(nodes[i].name), i);
+        }
+    }
+
+    /**
+     * Lays the nodes out depth first in the transform hierarchy, whatever their order in nodes.
+     */
+    void buildTransforms() {
+        std::vector<ubyte> isChild(nodes.size(), 0);
+        for (const Node<T>& node : nodes) {
+            for (const Node<T>* child : node.children) {
+                isChild[child - nodes.data()] = 1;
+            }
+        }
+
+        std::vector<uint32> parents;
+        parents.reserve(nodes.size());
+        std::vector<std::pair<Node<T>*, uint32>> stack;
+        for (uint32 i = nodes.size(); i-- > 0;) {
+            if (!isChild[i]) stack.push_back({&nodes[i], TransformHierarchy<T>::NO_PARENT});
         }
+        while (!stack.empty()) {
+            Node<T>* node = stack.back().first;
+            parents.push_back(stack.back().second);
+            stack.pop_back();
+
+            node->transforms = &transforms;
+            node->transformIndex = parents.size() - 1;
+            // Reversed so the first child is visited first
+            for (uint32 i = node->children.size(); i-- > 0;) {
+                stack.push_back({node->children[i], node->transformIndex});
+            }
+        }
+
+        transforms.reset(parents);
     }
 
-    // Loads a support assimp extension from file.
-    void loadModel(const std::string &path) {
+    bool importModel(const std::string& path) {
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path,
         aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -68,31 +216,56 @@ public:
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
         {
             std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
-            return;
+            return false;
         }
 
-        directory = path.substr(0, path.find_last_of('/'));
-
         // Count how many nodes are present
         uint32 numNodes = 0;
-        countNodes(scene->mRootNode, &numNodes);
+        std::vector<MeshData> meshes(scene->mNumMeshes);
+        countNodes(scene->mRootNode, &numNodes, meshes);
+
+        // Convert every mesh concurrently, only the GL buffers and textures are created on this thread
+        ThreadPool::global().parallelFor(0, scene->mNumMeshes, 1, [&](uint64 begin, uint64 end) {
+            for (uint64 i = begin; i < end; i++) {
+                convertMesh(scene->mMeshes[i], meshes[i]);
+            }
+        });
 
         // Process assimp data structure
         nodes = std::vector<Node<T>>(numNodes);
         uint32 idx = 0;
-        processNode(scene->mRootNode, scene, nullptr, &idx);
+        processNode(scene->mRootNode, scene, nullptr, &idx, meshes);
+        return true;
+    }
+
+    /**
+     * Loads the texture at path (relative to the model directory).
+     * Shared through the TextureCache, decoding happens in the background, the mesh draws with a placeholder until TextureLoader::processCompleted uploads it.
+     */
+    Texture loadTexture(const std::string& type, const std::string& path) {
+        Texture texture;
+        texture.handle = TextureCache::global().texture(this->directory + '/' + path, TextureLoader::placeholderFor(type),
+                                                       type == "texture_normal");
+        texture.id = *texture.handle;
+        texture.type = type;
+        texture.path = path;
+        return texture;
     }
 
-    void countNodes(aiNode *node, uint32* numNodes) {
+    void countNodes(aiNode *node, uint32* numNodes, std::vector<MeshData>& meshes) {
         (*numNodes)++;
 
+        for (uint32 i = 0; i < node->mNumMeshes; i++) {
+            meshes[node->mMeshes[i]].uses++;
+        }
+
         for(uint32 i = 0; i < node->mNumChildren; i++)
         {
-            countNodes(node->mChildren[i], numNodes);
+            countNodes(node->mChildren[i], numNodes, meshes);
         }
     }
 
-    void processNode(aiNode *node, const aiScene *scene, Node<T>* parent, uint32* nodeIndex)
+    void processNode(aiNode *node, const aiScene *scene, Node<T>* parent, uint32* nodeIndex, std::vector<MeshData>& meshes)
     {
         Node<T>* newNode = &(nodes[*nodeIndex]);
         (*nodeIndex)++;
@@ -103,7 +276,7 @@ public:
         for (uint32 i = 0; i < node->mNumMeshes; i++)
         {
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            newNode->meshes.push_back(processMesh(newNode, mesh, scene));
+            newNode->meshes.push_back(processMesh(newNode, mesh, scene, meshes[node->mMeshes[i]]));
         }
 
         if (parent != nullptr) {
@@ -113,15 +286,19 @@ public:
         // Process all the children of this node
         for(uint32 i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene, newNode, nodeIndex);
+            processNode(node->mChildren[i], scene, newNode, nodeIndex, meshes);
         }
     }
 
-    Mesh<T> processMesh(Node<T>* node, aiMesh *mesh, const aiScene *scene)
+    /**
+     * Copies the vertices and indices of mesh, does not touch GL so it can run on any thread.
+     */
+    static void convertMesh(const aiMesh* mesh, MeshData& data)
     {
-        std::vector<Vertex<T>> vertices;
-        std::vector<uint32> indices;
-        std::vector<Texture> textures;
+        std::vector<Vertex<T>>& vertices = data.vertices;
+        std::vector<uint32>& indices = data.indices;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(static_cast<uint64>(mesh->mNumFaces) * 3);
 
         for(uint32 i = 0; i < mesh->mNumVertices; i++)
         {
@@ -135,10 +312,14 @@ public:
             vertex.Position = vector;
 
             // Normals
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
+            if (mesh->mNormals) {
+                vector.x = mesh->mNormals[i].x;
+                vector.y = mesh->mNormals[i].y;
+                vector.z = mesh->mNormals[i].z;
+                vertex.Normal = vector;
+            } else {
+                vertex.Normal = Vec3<T> {0, 0, 0};
+            }
 
             // Texture coordinates
             if(mesh->mTextureCoords[0]) {
@@ -154,12 +335,15 @@ public:
                 vertex.TexCoords = Vec2<T> {0, 0};
             }
 
-            // Tangents
-            vector.x = mesh->mTangents[i].x;
-            vector.y = mesh->mTangents[i].y;
-            vector.z = mesh->mTangents[i].z;
-            vertex.Tangent = vector;
-
+            // Tangents, only generated by Assimp for meshes with normals and texture coordinates
+            if (mesh->mTangents) {
+                vector.x = mesh->mTangents[i].x;
+                vector.y = mesh->mTangents[i].y;
+                vector.z = mesh->mTangents[i].z;
+                vertex.Tangent = vector;
+            } else {
+                vertex.Tangent = Vec3<T> {0, 0, 0};
+            }
 
             vertices.push_back(vertex);
         }
@@ -167,10 +351,15 @@ public:
         // For each face get the indices
         for(uint32 i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace& face = mesh->mFaces[i];
             for(uint32 j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+    }
+
+    Mesh<T> processMesh(Node<T>* node, aiMesh *mesh, const aiScene *scene, MeshData& data)
+    {
+        std::vector<Texture> textures;
 
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -180,57 +369,39 @@ public:
         // diffuse: texture_diffuseN
         // specular: texture_specularN
         // normal: texture_normalN
-        std::vector<Texture> alreadyLoaded;
-
         // Diffuse maps
-        std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", alreadyLoaded);
+        std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
 
         // Specular maps
-        std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", alreadyLoaded);
+        std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 
         // Normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", alreadyLoaded);
+        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
 
         // Height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", alreadyLoaded);
+        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-        return Mesh<T>(node, mesh->mName.C_Str(), vertices, indices, textures);
+        // Meshes referenced by several nodes are copied, except for the last reference
+        if (--data.uses == 0) {
+            return Mesh<T>(node, mesh->mName.C_Str(), std::move(data.vertices), std::move(data.indices), textures);
+        }
+        return Mesh<T>(node, mesh->mName.C_Str(), data.vertices, data.indices, textures);
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // Loads all material textures of a given type, already loaded files are shared through the TextureCache.
     // the required info is returned as a Texture struct.
-    std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName, std::vector<Texture>& alreadyLoaded)
+    std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
     {
         std::vector<Texture> textures;
         for (uint32 i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(uint32 j = 0; j < alreadyLoaded.size(); j++)
-            {
-                if(std::strcmp(alreadyLoaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(alreadyLoaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                std::string texturePath = this->directory + '/' + str.C_Str();
-                texture.id = TextureLoader::textureFromFile(texturePath);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                alreadyLoaded.push_back(texture);
-            }
+            textures.push_back(loadTexture(typeName, str.C_Str()));
         }
         return textures;
     }
@@ -239,6 +410,28 @@ public:
         return nodes;
     }
 
+    /**
+     * Node named like handle in O(1), nullptr if there is none.
+     */
+    Node<T>* getNode(NodeHandle handle) {
+        auto it = nodeIndices.find(handle.name);
+        return it != nodeIndices.end() ? &nodes[it->second] : nullptr;
+    }
+
+    Node<T>* getNode(const std::string& name) {
+        return getNode(findNode(name));
+    }
+
+    /**
+     * Handle of the node called name without interning it, invalid if no node was ever given that name.
+     * NodeHandle(name) gives a handle for nodes that may only appear after a reload.
+     */
+    static NodeHandle findNode(const std::string& name) {
+        NodeHandle handle;
+        handle.name = NameTable::find(name);
+        return handle;
+    }
+
     void print() {
         std::cout << "Model name: " << directory << std::endl;
         for (uint32 i = 0; i < nodes.size(); i++) {
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "core_types.h"
+#include "instance_data.h"
+#include "model.h"
+#include "name_table.h"
+#include "shader_program.h"
+#include "thread_pool.h"
+#include "transform_hierarchy.h"
+
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Many placements of one loaded Model. The model's meshes, GL buffers, textures and hierarchy are shared,
+ * each instance only has its own local and world transforms.
+ * The transforms of all instances live in a single TransformHierarchy, instance k uses the slots
+ * [k * nodesPerInstance, (k + 1) * nodesPerInstance) laid out like the model's own, so one update covers them all.
+ * The model must outlive its instances. Reloading the model keeps the instances and their transforms (by node name).
+ */
+template <typename T = float32>
+class ModelInstances {
+private:
+    Model<T>& model;
+    TransformHierarchy<T> transforms;
+    uint32 numInstances = 0;
+    uint32 nodesPerInstance = 0;
+    // Model generation the slots were laid out for
+    uint32 generation = 0;
+    // Interned node name of each slot of an instance
+    std::vector<uint32> slotNames;
+    // Instance attributes of the node being drawn, reused between frames
+    std::vector<InstanceData> instanceData;
+
+    void layout() {
+        generation = model.getGeneration();
+        nodesPerInstance = model.getTransforms().size();
+        slotNames.assign(nodesPerInstance, NameTable::INVALID);
+        for (const Node<T>& node : model.getNodes()) {
+            if (node.transforms != nullptr) {
+                slotNames[node.transformIndex] = NameTable::intern(node.name);
+            }
+        }
+    }
+
+    // Lays the instances out again after the model was reloaded
+    void sync() {
+        if (generation == model.getGeneration()) return;
+
+        const TransformHierarchy<T> previous = std::move(transforms);
+        const std::vector<uint32> previousNames = std::move(slotNames);
+        const uint32 previousNodes = nodesPerInstance;
+
+        transforms = TransformHierarchy<T>();
+        layout();
+        for (uint32 instance = 0; instance < numInstances; instance++) {
+            transforms.append(model.getTransforms());
+            for (uint32 i = 0; i < previousNodes; i++) {
+                NodeHandle handle;
+                handle.name = previousNames[i];
+                if (const Node<T>* node = model.getNode(handle)) {
+                    transforms.setLocal(slot(instance, *node), previous.getLocal(instance * previousNodes + i));
+                }
+            }
+        }
+    }
+
+public:
+    explicit ModelInstances(Model<T>& model, uint32 count = 0) : model(model) {
+        layout();
+        for (uint32 i = 0; i < count; i++) {
+            add();
+        }
+    }
+
+    /**
+     * Adds an instance starting with the model's local transforms, returns its index.
+     */
+    uint32 add() {
+        sync();
+        transforms.append(model.getTransforms());
+        return numInstances++;
+    }
+
+    uint32 size() const {
+        return numInstances;
+    }
+
+    Model<T>& getModel() {
+        return model;
+    }
+
+    TransformHierarchy<T>& getTransforms() {
+        return transforms;
+    }
+
+    // Slot of node (of the model) for instance
+    uint32 slot(uint32 instance, const Node<T>& node) const {
+        return instance * nodesPerInstance + node.transformIndex;
+    }
+
+    /**
+     * node indexes Model::getNodes.
+     */
+    void setLocalTransform(uint32 instance, uint32 node, const Mat4<T>& local) {
+        sync();
+        transforms.setLocal(slot(instance, model.getNodes()[node]), local);
+    }
+
+    /**
+     * Ignored if the model has no node with the name of handle.
+     */
+    void setLocalTransform(uint32 instance, NodeHandle handle, const Mat4<T>& local) {
+        sync();
+        if (const Node<T>* node = model.getNode(handle)) {
+            transforms.setLocal(slot(instance, *node), local);
+        }
+    }
+
+    const Mat4<T>& getLocalTransform(uint32 instance, uint32 node) {
+        sync();
+        return transforms.getLocal(slot(instance, model.getNodes()[node]));
+    }
+
+    /**
+     * As of the last update (draw runs it).
+     */
+    const Mat4<T>& getWorldTransform(uint32 instance, uint32 node) {
+        sync();
+        return transforms.getWorld(slot(instance, model.getNodes()[node]));
+    }
+
+    /**
+     * Brings the world transforms of every instance up to date, see TransformHierarchy::update.
+     */
+    uint32 update(ThreadPool& pool = ThreadPool::global()) {
+        sync();
+        return transforms.update(&pool);
+    }
+
+    /**
+     * Draws every instance with one instanced draw call per mesh (see Mesh::drawInstanced), the shader must
+     * support instancing. Otherwise pass instanced = false: textures and vertex arrays are still bound once per mesh
+     * but each instance is drawn with its own transform uniforms.
+     */
+    void draw(const ShaderProgram& shaderProgram, const Mat4<T>& projection, const Mat4<T>& view, bool instanced = true) {
+        update();
+
+        for (Node<T>& node : model.getNodes()) {
+            if (node.meshes.empty()) continue;
+
+            if (instanced) {
+                instanceData.resize(numInstances);
+                for (uint32 instance = 0; instance < numInstances; instance++) {
+                    const uint32 i = slot(instance, node);
+                    instanceData[instance] = InstanceData(transforms.getWorld(i), transforms.getNormalMatrix(i));
+                }
+                for (Mesh<T>& mesh : node.meshes) {
+                    mesh.drawInstanced(shaderProgram, projection, view, instanceData);
+                }
+                continue;
+            }
+
+            for (const Mesh<T>& mesh : node.meshes) {
+                mesh.bindTextures(shaderProgram);
+                glBindVertexArray(mesh.VAO);
+                for (uint32 instance = 0; instance < numInstances; instance++) {
+                    const uint32 i = slot(instance, node);
+                    mesh.setTransform(shaderProgram, projection, view, transforms.getWorld(i), transforms.getNormalMatrix(i));
+                    mesh.drawElements();
+                }
+                glBindVertexArray(0);
+                glActiveTexture(GL_TEXTURE0);
+            }
+        }
+    }
+};
+
+}; // namespace cglib
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "core_types.h"
+
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace cglib {
+
+/**
+ * Process wide table of interned names, each distinct string gets a small id that never changes.
+ * Comparing and hashing ids is what makes name lookups cheap. Thread safe.
+ */
+class NameTable {
+public:
+    static constexpr uint32 INVALID = 0xFFFFFFFF;
+
+private:
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, uint32> ids;
+    // Deque, so references to the names stay valid while the table grows
+    std::deque<std::string> names;
+
+    NameTable() {}
+
+    static NameTable& global() {
+        // Never destroyed, ids may be used by static objects
+        static NameTable* table = new NameTable();
+        return *table;
+    }
+
+public:
+    NameTable(const NameTable&) = delete;
+    NameTable& operator=(const NameTable&) = delete;
+
+    /**
+     * Id of name, added to the table the first time it is seen.
+     */
+    static uint32 intern(const std::string& name) {
+        NameTable& table = global();
+        {
+            std::shared_lock<std::shared_mutex> lock(table.mutex);
+            auto it = table.ids.find(name);
+            if (it != table.ids.end()) return it->second;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(table.mutex);
+        auto inserted = table.ids.emplace(name, table.names.size());
+        if (inserted.second) {
+            table.names.push_back(name);
+        }
+        return inserted.first->second;
+    }
+
+    /**
+     * Id of name or INVALID if it was never interned, does not grow the table.
+     */
+    static uint32 find(const std::string& name) {
+        NameTable& table = global();
+        std::shared_lock<std::shared_mutex> lock(table.mutex);
+        auto it = table.ids.find(name);
+        return it != table.ids.end() ? it->second : INVALID;
+    }
+
+    static const std::string& name(uint32 id) {
+        NameTable& table = global();
+        std::shared_lock<std::shared_mutex> lock(table.mutex);
+        return table.names[id];
+    }
+};
+
+/**
+ * Refers to a node of a Model by interned name, resolved in O(1) by Model::getNode.
+ * Stays valid when the model is reloaded, as long as a node with the same name exists.
+ */
+struct NodeHandle {
+    uint32 name = NameTable::INVALID;
+
+    NodeHandle() {}
+
+    explicit NodeHandle(const std::string& name) : name(NameTable::intern(name)) {}
+
+    bool isValid() const {
+        return name != NameTable::INVALID;
+    }
+
+    bool operator==(const NodeHandle& other) const {
+        return name == other.name;
+    }
+
+    bool operator!=(const NodeHandle& other) const {
+        return name != other.name;
+    }
+};
+
+}; // namespace cglib
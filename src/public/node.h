@@ -2,6 +2,7 @@
 
 #include "core_types.h"
 #include "mesh.h"
+#include "transform_hierarchy.h"
 
 namespace cglib {
 
@@ -13,7 +14,37 @@ struct Node {
     std::string name;
     std::vector<Mesh<T>> meshes;
     std::vector<Node<T>*> children;
-    Mat4<T> model = Mat4<T>::identity();
+
+    // Slot in the TransformHierarchy of the owning Model, assigned once the model is loaded
+    TransformHierarchy<T>* transforms = nullptr;
+    uint32 transformIndex = 0;
+
+    const Mat4<T>& getLocalTransform() const {
+        return transforms->getLocal(transformIndex);
+    }
+
+    /**
+     * Takes effect on the next TransformHierarchy::update (Model::draw runs it).
+     */
+    void setLocalTransform(const Mat4<T>& local) {
+        transforms->setLocal(transformIndex, local);
+    }
+
+    /**
+     * Model matrix of the node, the identity for nodes that do not belong to a Model.
+     */
+    const Mat4<T>& getWorldTransform() const {
+        static const Mat4<T> identity = Mat4<T>::identity();
+        return transforms != nullptr ? transforms->getWorld(transformIndex) : identity;
+    }
+
+    /**
+     * Transposed inverse of the upper 3x3 of the world transform, cached until it changes.
+     */
+    const Mat3<T>& normalMatrix() {
+        static const Mat3<T> identity = Mat3<T>::identity();
+        return transforms != nullptr ? transforms->getNormalMatrix(transformIndex) : identity;
+    }
 };
 
 }; // namespace cglib
\ No newline at end of file
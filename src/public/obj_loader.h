@@ -0,0 +1,594 @@
+#pragma once
+
+#include "core_types.h"
+#include "vec2.h"
+#include "vec3.h"
+#include "vertex.h"
+#include "texture.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cglib {
+
+template <typename T>
+struct Node;
+
+template <typename T>
+class Mesh;
+
+/**
+ * Wavefront OBJ/MTL loader producing the same layout Model gets from Assimp with
+ * aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace:
+ * a root node with one child per object ('o' or 'g'), and one mesh per material used by the object.
+ *
+ * The file is memory mapped and cut in chunks at line boundaries that are parsed in parallel into
+ * per-chunk attribute and face buffers, merged once every chunk is done. Meshes are then welded
+ * (one vertex per distinct position/uv/normal triple) and get their tangents in parallel as well.
+ * Only the Mesh objects, which create GL buffers, are built on the calling thread.
+ */
+template <typename T = float32>
+class ObjLoader {
+public:
+    using LoadTexture = std::function<Texture(const std::string& type, const std::string& path)>;
+
+    struct MeshData {
+        std::string name;
+        std::string material;
+        std::vector<Vertex<T>> vertices;
+        std::vector<uint32> indices;
+    };
+
+    struct ObjectData {
+        std::string name;
+        std::vector<MeshData> meshes;
+    };
+
+    struct MaterialData {
+        // (type, path) pairs, types named like the shader samplers of Mesh::draw
+        std::vector<std::pair<std::string, std::string>> textures;
+    };
+
+    struct SceneData {
+        std::vector<ObjectData> objects;
+        std::unordered_map<std::string, MaterialData> materials;
+        // Paths of the MTL libraries referenced by the file, whether they could be read or not
+        std::vector<std::string> libraries;
+    };
+
+private:
+    // Smallest chunk handed to a single task
+    static constexpr uint64 MIN_CHUNK_SIZE = 1 << 18;
+    static constexpr int32 MISSING = -1;
+
+    // Face corner, 0-based attribute indices. Relative (negative) indices are resolved against the chunk first
+    // and flagged so that the chunk offset is added when merging.
+    struct Corner {
+        int32 index[3];
+        uint8 relative;
+    };
+
+    struct Statement {
+        enum Kind { OBJECT, MATERIAL, LIBRARY } kind;
+        // Triangles of the chunk defined before the statement
+        uint64 triangle;
+        std::string name;
+    };
+
+    struct Chunk {
+        std::vector<Vec3<T>> positions;
+        std::vector<Vec2<T>> texCoords;
+        std::vector<Vec3<T>> normals;
+        // Three per triangle
+        std::vector<Corner> corners;
+        std::vector<Statement> statements;
+    };
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    static bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static const char* skipSpaces(const char* p, const char* end) {
+        while (p < end && isSpace(*p)) p++;
+        return p;
+    }
+
+    static const char* lineEnd(const char* p, const char* end) {
+        while (p < end && *p != '\n') p++;
+        return p;
+    }
+
+    // Rest of the line without surrounding blanks
+    static std::string restOfLine(const char* p, const char* end) {
+        p = skipSpaces(p, end);
+        const char* e = lineEnd(p, end);
+        while (e > p && (isSpace(e[-1]) || e[-1] == '\r')) e--;
+        return std::string(p, e);
+    }
+
+    /**
+     * Locale independent decimal parser, about an order of magnitude faster than strtod.
+     */
+    static const char* parseFloat(const char* p, const char* end, T& out) {
+        static const float64 powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+        p = skipSpaces(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+
+        uint64 mantissa = 0;
+        int32 exponent = 0, digits = 0;
+        for (; p < end && isDigit(*p); p++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa > 0;
+            } else {
+                exponent++;
+            }
+        }
+        if (p < end && *p == '.') {
+            for (p++; p < end && isDigit(*p); p++) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa > 0;
+                    exponent--;
+                }
+            }
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negativeExponent = *p == '-';
+                p++;
+            }
+            int32 e = 0;
+            for (; p < end && isDigit(*p); p++) {
+                e = std::min(e * 10 + (*p - '0'), 9999);
+            }
+            exponent += negativeExponent ? -e : e;
+        }
+
+        float64 value = mantissa;
+        if (exponent >= -22 && exponent <= 22) {
+            value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+        } else {
+            value *= std::pow(10.0, exponent);
+        }
+        out = negative ? -value : value;
+        return p;
+    }
+
+    static const char* parseInt(const char* p, const char* end, int32& out, bool& present) {
+        bool negative = false;
+        if (p < end && *p == '-') {
+            negative = true;
+            p++;
+        }
+        int32 value = 0;
+        present = p < end && isDigit(*p);
+        for (; p < end && isDigit(*p); p++) {
+            value = value * 10 + (*p - '0');
+        }
+        out = negative ? -value : value;
+        return p;
+    }
+
+    static void parseFace(const char* p, const char* end, Chunk& chunk) {
+        const int32 counts[3] = {static_cast<int32>(chunk.positions.size()), static_cast<int32>(chunk.texCoords.size()),
+                                 static_cast<int32>(chunk.normals.size())};
+
+        Corner first = {}, previous = {};
+        uint32 numCorners = 0;
+        while (true) {
+            p = skipSpaces(p, end);
+            if (p >= end || *p == '\r' || *p == '#') break;
+
+            Corner corner = {{MISSING, MISSING, MISSING}, 0};
+            for (uint8 k = 0; k < 3; k++) {
+                int32 value;
+                bool present;
+                p = parseInt(p, end, value, present);
+                if (present && value != 0) {
+                    if (value > 0) {
+                        corner.index[k] = value - 1;
+                    } else {
+                        corner.index[k] = counts[k] + value;
+                        corner.relative |= 1 << k;
+                    }
+                }
+                if (p >= end || *p != '/') break;
+                p++;
+            }
+            // Skip anything unexpected up to the next corner
+            while (p < end && !isSpace(*p) && *p != '\r') p++;
+
+            // Fan triangulation
+            if (numCorners == 0) {
+                first = corner;
+            } else if (numCorners >= 2) {
+                chunk.corners.push_back(first);
+                chunk.corners.push_back(previous);
+                chunk.corners.push_back(corner);
+            }
+            previous = corner;
+            numCorners++;
+        }
+    }
+
+    static void parseChunk(const char* p, const char* end, Chunk& chunk) {
+        while (p < end) {
+            p = skipSpaces(p, end);
+            const char* e = lineEnd(p, end);
+            const uint64 length = e - p;
+
+            if (length >= 2 && p[0] == 'v' && isSpace(p[1])) {
+                Vec3<T> v;
+                const char* q = parseFloat(p + 2, e, v.x);
+                q = parseFloat(q, e, v.y);
+                parseFloat(q, e, v.z);
+                chunk.positions.push_back(v);
+            } else if (length >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+                Vec2<T> v {0, 0};
+                const char* q = parseFloat(p + 3, e, v.x);
+                parseFloat(q, e, v.y);
+                // aiProcess_FlipUVs
+                v.y = 1 - v.y;
+                chunk.texCoords.push_back(v);
+            } else if (length >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+                Vec3<T> v;
+                const char* q = parseFloat(p + 3, e, v.x);
+                q = parseFloat(q, e, v.y);
+                parseFloat(q, e, v.z);
+                chunk.normals.push_back(v);
+            } else if (length >= 2 && p[0] == 'f' && isSpace(p[1])) {
+                parseFace(p + 2, e, chunk);
+            } else if (length >= 2 && (p[0] == 'o' || p[0] == 'g') && isSpace(p[1])) {
+                chunk.statements.push_back({Statement::OBJECT, chunk.corners.size() / 3, restOfLine(p + 2, e)});
+            } else if (length >= 7 && std::equal(p, p + 6, "usemtl") && isSpace(p[6])) {
+                chunk.statements.push_back({Statement::MATERIAL, chunk.corners.size() / 3, restOfLine(p + 7, e)});
+            } else if (length >= 7 && std::equal(p, p + 6, "mtllib") && isSpace(p[6])) {
+                chunk.statements.push_back({Statement::LIBRARY, chunk.corners.size() / 3, restOfLine(p + 7, e)});
+            }
+
+            p = e + 1;
+        }
+    }
+
+    // Texture paths written on Windows use backslashes, possibly doubled
+    static std::string normalizePath(std::string path) {
+        std::replace(path.begin(), path.end(), '\\', '/');
+        path.erase(std::unique(path.begin(), path.end(), [](char a, char b) { return a == '/' && b == '/'; }), path.end());
+        return path;
+    }
+
+    // File name of a map statement, after its options (e.g. "-bm 0.5 normal.png")
+    static std::string mapPath(const std::string& arguments) {
+        const char* p = arguments.data();
+        const char* end = p + arguments.size();
+        p = skipSpaces(p, end);
+        while (p < end && *p == '-') {
+            while (p < end && !isSpace(*p)) p++;
+            p = skipSpaces(p, end);
+            // Numeric option arguments
+            while (p < end && (isDigit(*p) || ((*p == '-' || *p == '.') && p + 1 < end && (isDigit(p[1]) || p[1] == '.')))) {
+                while (p < end && !isSpace(*p)) p++;
+                p = skipSpaces(p, end);
+            }
+        }
+        return normalizePath(std::string(p, end));
+    }
+
+    static void parseMaterials(const std::string& path, std::unordered_map<std::string, MaterialData>& materials) {
+        const MappedFile file(path);
+        if (!file.isOpen()) return;
+
+        const char* p = reinterpret_cast<const char*>(file.getData());
+        const char* end = p + file.getSize();
+        MaterialData* current = nullptr;
+        while (p < end) {
+            p = skipSpaces(p, end);
+            const char* e = lineEnd(p, end);
+            const char* keyEnd = p;
+            while (keyEnd < e && !isSpace(*keyEnd) && *keyEnd != '\r') keyEnd++;
+            const std::string key(p, keyEnd);
+            const std::string value = restOfLine(keyEnd, e);
+
+            if (key == "newmtl") {
+                current = &materials[value];
+            } else if (current != nullptr) {
+                // Same texture types Assimp reports and Model maps to sampler names
+                if (key == "map_Kd") {
+                    current->textures.emplace_back("texture_diffuse", mapPath(value));
+                } else if (key == "map_Ks") {
+                    current->textures.emplace_back("texture_specular", mapPath(value));
+                } else if (key == "map_Bump" || key == "map_bump" || key == "bump") {
+                    current->textures.emplace_back("texture_normal", mapPath(value));
+                } else if (key == "map_Ka") {
+                    current->textures.emplace_back("texture_height", mapPath(value));
+                }
+            }
+            p = e + 1;
+        }
+
+        // Keep the order Model uses: diffuse, specular, normal, height
+        static const std::string order[] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+        for (auto& m : materials) {
+            std::stable_sort(m.second.textures.begin(), m.second.textures.end(), [](const auto& a, const auto& b) {
+                return std::find(order, order + 4, a.first) < std::find(order, order + 4, b.first);
+            });
+        }
+    }
+
+    struct CornerHash {
+        uint64 operator()(const Corner& c) const {
+            uint64 h = static_cast<uint32>(c.index[0]);
+            h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32>(c.index[1]);
+            h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32>(c.index[2]);
+            return h ^ (h >> 29);
+        }
+    };
+
+    struct CornerEqual {
+        bool operator()(const Corner& a, const Corner& b) const {
+            return a.index[0] == b.index[0] && a.index[1] == b.index[1] && a.index[2] == b.index[2];
+        }
+    };
+
+    /**
+     * Welds the corners of a mesh into indexed vertices and computes normals (if the file has none) and tangents.
+     */
+    static void buildMesh(const std::vector<Corner>& corners, const std::vector<Vec3<T>>& positions,
+                          const std::vector<Vec2<T>>& texCoords, const std::vector<Vec3<T>>& normals, MeshData& mesh) {
+        std::unordered_map<Corner, uint32, CornerHash, CornerEqual> welded;
+        welded.reserve(corners.size());
+        mesh.indices.reserve(corners.size());
+
+        for (const Corner& c : corners) {
+            auto inserted = welded.emplace(c, static_cast<uint32>(mesh.vertices.size()));
+            if (inserted.second) {
+                Vertex<T> v;
+                v.Position = c.index[0] >= 0 && c.index[0] < static_cast<int32>(positions.size()) ? positions[c.index[0]] : Vec3<T> {0, 0, 0};
+                v.TexCoords = c.index[1] >= 0 && c.index[1] < static_cast<int32>(texCoords.size()) ? texCoords[c.index[1]] : Vec2<T> {0, 0};
+                v.Normal = c.index[2] >= 0 && c.index[2] < static_cast<int32>(normals.size()) ? normals[c.index[2]] : Vec3<T> {0, 0, 0};
+                v.Tangent = {0, 0, 0};
+                mesh.vertices.push_back(v);
+            }
+            mesh.indices.push_back(inserted.first->second);
+        }
+
+        const bool computeNormals = normals.empty();
+        for (uint64 i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            Vertex<T>& a = mesh.vertices[mesh.indices[i]];
+            Vertex<T>& b = mesh.vertices[mesh.indices[i + 1]];
+            Vertex<T>& c = mesh.vertices[mesh.indices[i + 2]];
+
+            const Vec3<T> e1 = b.Position - a.Position, e2 = c.Position - a.Position;
+            const T du1 = b.TexCoords.x - a.TexCoords.x, dv1 = b.TexCoords.y - a.TexCoords.y;
+            const T du2 = c.TexCoords.x - a.TexCoords.x, dv2 = c.TexCoords.y - a.TexCoords.y;
+
+            // Area weighted accumulation over the triangles sharing a vertex
+            const T det = du1 * dv2 - du2 * dv1;
+            if (det != 0) {
+                const Vec3<T> tangent = (e1 * dv2 - e2 * dv1) * (1 / det);
+                a.Tangent += tangent;
+                b.Tangent += tangent;
+                c.Tangent += tangent;
+            }
+            if (computeNormals) {
+                const Vec3<T> normal = e1.cross(e2);
+                a.Normal += normal;
+                b.Normal += normal;
+                c.Normal += normal;
+            }
+        }
+
+        for (Vertex<T>& v : mesh.vertices) {
+            if (computeNormals && v.Normal.length() > 0) {
+                v.Normal.normalize();
+            }
+
+            // Gram-Schmidt against the normal, any perpendicular direction when the uvs are degenerate
+            Vec3<T> t = v.Tangent - v.Normal * v.Normal.dot(v.Tangent);
+            if (t.length() <= std::numeric_limits<T>::epsilon()) {
+                t = std::abs(v.Normal.x) < T(0.9) ? Vec3<T> {1, 0, 0}.cross(v.Normal) : Vec3<T> {0, 1, 0}.cross(v.Normal);
+            }
+            if (t.length() > 0) {
+                t.normalize();
+            }
+            v.Tangent = t;
+        }
+    }
+
+public:
+    /**
+     * Parses the OBJ file at path and the MTL libraries it references, without any GL call.
+     * Returns false if the file cannot be read.
+     */
+    static bool parse(const std::string& path, SceneData& scene, ThreadPool& pool = ThreadPool::global()) {
+        const MappedFile file(path);
+        if (!file.isOpen()) return false;
+
+        const char* data = reinterpret_cast<const char*>(file.getData());
+        const uint64 size = file.getSize();
+
+        // Chunk boundaries right after a newline
+        const uint64 target = std::max<uint64>(MIN_CHUNK_SIZE, size / (4 * std::max<uint32>(1, pool.size())) + 1);
+        std::vector<uint64> bounds = {0};
+        while (bounds.back() < size) {
+            uint64 b = std::min(size, bounds.back() + target);
+            while (b < size && data[b - 1] != '\n') b++;
+            bounds.push_back(b);
+        }
+
+        const uint64 numChunks = bounds.size() - 1;
+        std::vector<Chunk> chunks(numChunks);
+        pool.parallelFor(0, numChunks, 1, [&](uint64 begin, uint64 end) {
+            for (uint64 c = begin; c < end; c++) {
+                parseChunk(data + bounds[c], data + bounds[c + 1], chunks[c]);
+            }
+        });
+
+        // Offsets of every chunk in the merged attribute and triangle arrays
+        std::vector<uint64> positionBase(numChunks + 1, 0), texCoordBase(numChunks + 1, 0);
+        std::vector<uint64> normalBase(numChunks + 1, 0), triangleBase(numChunks + 1, 0);
+        for (uint64 c = 0; c < numChunks; c++) {
+            positionBase[c + 1] = positionBase[c] + chunks[c].positions.size();
+            texCoordBase[c + 1] = texCoordBase[c] + chunks[c].texCoords.size();
+            normalBase[c + 1] = normalBase[c] + chunks[c].normals.size();
+            triangleBase[c + 1] = triangleBase[c] + chunks[c].corners.size() / 3;
+        }
+
+        std::vector<Vec3<T>> positions(positionBase.back());
+        std::vector<Vec2<T>> texCoords(texCoordBase.back());
+        std::vector<Vec3<T>> normals(normalBase.back());
+        std::vector<Corner> corners(triangleBase.back() * 3);
+        pool.parallelFor(0, numChunks, 1, [&](uint64 begin, uint64 end) {
+            for (uint64 c = begin; c < end; c++) {
+                Chunk& chunk = chunks[c];
+                std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionBase[c]);
+                std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + texCoordBase[c]);
+                std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalBase[c]);
+
+                const int32 base[3] = {static_cast<int32>(positionBase[c]), static_cast<int32>(texCoordBase[c]),
+                                       static_cast<int32>(normalBase[c])};
+                Corner* out = &corners[triangleBase[c] * 3];
+                for (Corner corner : chunk.corners) {
+                    for (uint8 k = 0; k < 3; k++) {
+                        if (corner.relative & (1 << k)) {
+                            corner.index[k] += base[k];
+                        }
+                    }
+                    *out++ = corner;
+                }
+
+                chunk.positions = {};
+                chunk.texCoords = {};
+                chunk.normals = {};
+                chunk.corners = {};
+            }
+        });
+
+        // Triangle ranges of every (object, material) pair, in file order
+        struct MeshRanges {
+            uint32 object;
+            std::string material;
+            std::vector<std::pair<uint64, uint64>> ranges;
+        };
+        std::vector<MeshRanges> meshRanges;
+        std::vector<std::string> libraries;
+        int32 object = -1;
+        std::string material;
+        uint64 rangeBegin = 0;
+
+        auto closeRange = [&](uint64 rangeEnd) {
+            if (rangeEnd > rangeBegin) {
+                if (object < 0) {
+                    // Faces before any object statement
+                    scene.objects.push_back({"defaultobject", {}});
+                    object = scene.objects.size() - 1;
+                }
+                auto it = std::find_if(meshRanges.begin(), meshRanges.end(), [&](const MeshRanges& m) {
+                    return m.object == static_cast<uint32>(object) && m.material == material;
+                });
+                if (it == meshRanges.end()) {
+                    meshRanges.push_back({static_cast<uint32>(object), material, {}});
+                    it = meshRanges.end() - 1;
+                }
+                it->ranges.emplace_back(rangeBegin, rangeEnd);
+            }
+            rangeBegin = rangeEnd;
+        };
+
+        for (uint64 c = 0; c < numChunks; c++) {
+            for (const Statement& s : chunks[c].statements) {
+                closeRange(triangleBase[c] + s.triangle);
+                if (s.kind == Statement::OBJECT) {
+                    scene.objects.push_back({s.name, {}});
+                    object = scene.objects.size() - 1;
+                } else if (s.kind == Statement::MATERIAL) {
+                    material = s.name;
+                } else {
+                    libraries.push_back(s.name);
+                }
+            }
+        }
+        closeRange(triangleBase.back());
+
+        std::vector<MeshData> meshes(meshRanges.size());
+        pool.parallelFor(0, meshRanges.size(), 1, [&](uint64 begin, uint64 end) {
+            for (uint64 m = begin; m < end; m++) {
+                std::vector<Corner> meshCorners;
+                for (const auto& r : meshRanges[m].ranges) {
+                    meshCorners.insert(meshCorners.end(), corners.begin() + r.first * 3, corners.begin() + r.second * 3);
+                }
+                meshes[m].name = scene.objects[meshRanges[m].object].name;
+                meshes[m].material = meshRanges[m].material;
+                buildMesh(meshCorners, positions, texCoords, normals, meshes[m]);
+            }
+        });
+        for (uint64 m = 0; m < meshes.size(); m++) {
+            scene.objects[meshRanges[m].object].meshes.push_back(std::move(meshes[m]));
+        }
+
+        const std::string directory = path.substr(0, path.find_last_of('/'));
+        for (const std::string& library : libraries) {
+            scene.libraries.push_back(directory + '/' + normalizePath(library));
+            parseMaterials(scene.libraries.back(), scene.materials);
+        }
+        return true;
+    }
+
+    /**
+     * Loads path into nodes: the root node first, followed by one node per object.
+     * Textures referenced by the materials are created through loadTexture, with paths relative to the OBJ directory.
+     * If given, libraries receives the paths of the MTL files the materials were read from.
+     */
+    static bool load(const std::string& path, std::vector<Node<T>>& nodes, const LoadTexture& loadTexture,
+                     std::vector<std::string>* libraries = nullptr, ThreadPool& pool = ThreadPool::global()) {
+        SceneData scene;
+        if (!parse(path, scene, pool)) return false;
+        if (libraries != nullptr) {
+            *libraries = scene.libraries;
+        }
+
+        nodes = std::vector<Node<T>>(scene.objects.size() + 1);
+        nodes[0].name = path.substr(path.find_last_of('/') + 1);
+
+        for (uint32 i = 0; i < scene.objects.size(); i++) {
+            Node<T>& node = nodes[i + 1];
+            node.name = scene.objects[i].name;
+            nodes[0].children.push_back(&node);
+
+            for (MeshData& mesh : scene.objects[i].meshes) {
+                std::vector<Texture> textures;
+                const auto material = scene.materials.find(mesh.material);
+                if (material != scene.materials.end()) {
+                    for (const auto& texture : material->second.textures) {
+                        textures.push_back(loadTexture(texture.first, texture.second));
+                    }
+                }
+                node.meshes.push_back(Mesh<T>(&node, mesh.name, std::move(mesh.vertices), std::move(mesh.indices), textures));
+            }
+        }
+        return true;
+    }
+};
+
+}; // namespace cglib
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "core_types.h"
+#include "simd.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <type_traits>
 
 namespace cglib {
 
@@ -57,6 +60,212 @@ private:
         }
     }
 
+    // Vectorized versions of the functions above. The operations are the same and happen in the same order
+    // as in the scalar code, so every lane is bit-identical to noise(x, y, z) as long as the compiler does not
+    // contract the scalar code into fused multiply-adds (-ffp-contract=off, the default in ISO C++ modes).
+    // grad() is evaluated branch-free as in the reference implementation:
+    // u = h < 8 ? x : y, v = h < 4 ? y : (h == 12 || h == 14 ? x : z), with the signs taken from the first two bits.
+
+#ifdef CGLIB_AVX2
+    static __m256 fade8(__m256 t) {
+        const __m256 t3 = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+        const __m256 poly = _mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6)), _mm256_set1_ps(15)));
+        return _mm256_mul_ps(t3, _mm256_add_ps(poly, _mm256_set1_ps(10)));
+    }
+
+    static __m256 lerp8(__m256 t, __m256 a, __m256 b) {
+        return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+    }
+
+    static __m256i perm8(__m256i idx) {
+        return _mm256_i32gather_epi32(reinterpret_cast<const int*>(p), idx, 4);
+    }
+
+    static __m256 grad8(__m256i hash, __m256 x, __m256 y, __m256 z) {
+        const __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(0xF));
+        const __m256 lt8 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+        const __m256 lt4 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+        const __m256 isX = _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)),
+                                                                _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+
+        const __m256 u = _mm256_blendv_ps(y, x, lt8);
+        const __m256 v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, isX), y, lt4);
+
+        const __m256 signU = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31));
+        const __m256 signV = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30));
+        return _mm256_add_ps(_mm256_xor_ps(u, signU), _mm256_xor_ps(v, signV));
+    }
+
+    static __m256 noise8(__m256 x, __m256 y, __m256 z) {
+        const __m256 fx = _mm256_floor_ps(x), fy = _mm256_floor_ps(y), fz = _mm256_floor_ps(z);
+        const __m256i mask = _mm256_set1_epi32(255);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i xi = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+        const __m256i yi = _mm256_and_si256(_mm256_cvttps_epi32(fy), mask);
+        const __m256i zi = _mm256_and_si256(_mm256_cvttps_epi32(fz), mask);
+
+        x = _mm256_sub_ps(x, fx);
+        y = _mm256_sub_ps(y, fy);
+        z = _mm256_sub_ps(z, fz);
+
+        const __m256 u = fade8(x), v = fade8(y), w = fade8(z);
+
+        const __m256i a = _mm256_add_epi32(perm8(xi), yi);
+        const __m256i aa = _mm256_add_epi32(perm8(a), zi);
+        const __m256i ab = _mm256_add_epi32(perm8(_mm256_add_epi32(a, one)), zi);
+        const __m256i b = _mm256_add_epi32(perm8(_mm256_add_epi32(xi, one)), yi);
+        const __m256i ba = _mm256_add_epi32(perm8(b), zi);
+        const __m256i bb = _mm256_add_epi32(perm8(_mm256_add_epi32(b, one)), zi);
+
+        const __m256 c1 = _mm256_set1_ps(1);
+        const __m256 x1 = _mm256_sub_ps(x, c1), y1 = _mm256_sub_ps(y, c1), z1 = _mm256_sub_ps(z, c1);
+
+        return lerp8(w, lerp8(v, lerp8(u, grad8(perm8(aa), x, y, z),
+                                          grad8(perm8(ba), x1, y, z)),
+                                 lerp8(u, grad8(perm8(ab), x, y1, z),
+                                          grad8(perm8(bb), x1, y1, z))),
+                        lerp8(v, lerp8(u, grad8(perm8(_mm256_add_epi32(aa, one)), x, y, z1),
+                                          grad8(perm8(_mm256_add_epi32(ba, one)), x1, y, z1)),
+                                 lerp8(u, grad8(perm8(_mm256_add_epi32(ab, one)), x, y1, z1),
+                                          grad8(perm8(_mm256_add_epi32(bb, one)), x1, y1, z1))));
+    }
+
+    // float64 lanes with 32-bit indices
+    static __m256d fade4(__m256d t) {
+        const __m256d t3 = _mm256_mul_pd(_mm256_mul_pd(t, t), t);
+        const __m256d poly = _mm256_mul_pd(t, _mm256_sub_pd(_mm256_mul_pd(t, _mm256_set1_pd(6)), _mm256_set1_pd(15)));
+        return _mm256_mul_pd(t3, _mm256_add_pd(poly, _mm256_set1_pd(10)));
+    }
+
+    static __m256d lerp4(__m256d t, __m256d a, __m256d b) {
+        return _mm256_add_pd(a, _mm256_mul_pd(t, _mm256_sub_pd(b, a)));
+    }
+
+    static __m128i perm4(__m128i idx) {
+        return _mm_i32gather_epi32(reinterpret_cast<const int*>(p), idx, 4);
+    }
+
+    static __m256d grad4(__m128i hash, __m256d x, __m256d y, __m256d z) {
+        const __m256i h = _mm256_cvtepi32_epi64(_mm_and_si128(hash, _mm_set1_epi32(0xF)));
+        const __m256d lt8 = _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(8), h));
+        const __m256d lt4 = _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(4), h));
+        const __m256d isX = _mm256_castsi256_pd(_mm256_or_si256(_mm256_cmpeq_epi64(h, _mm256_set1_epi64x(12)),
+                                                                 _mm256_cmpeq_epi64(h, _mm256_set1_epi64x(14))));
+
+        const __m256d u = _mm256_blendv_pd(y, x, lt8);
+        const __m256d v = _mm256_blendv_pd(_mm256_blendv_pd(z, x, isX), y, lt4);
+
+        const __m256d signU = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(h, _mm256_set1_epi64x(1)), 63));
+        const __m256d signV = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(h, _mm256_set1_epi64x(2)), 62));
+        return _mm256_add_pd(_mm256_xor_pd(u, signU), _mm256_xor_pd(v, signV));
+    }
+
+    static __m256d noise4(__m256d x, __m256d y, __m256d z) {
+        const __m256d fx = _mm256_floor_pd(x), fy = _mm256_floor_pd(y), fz = _mm256_floor_pd(z);
+        const __m128i mask = _mm_set1_epi32(255);
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128i xi = _mm_and_si128(_mm256_cvttpd_epi32(fx), mask);
+        const __m128i yi = _mm_and_si128(_mm256_cvttpd_epi32(fy), mask);
+        const __m128i zi = _mm_and_si128(_mm256_cvttpd_epi32(fz), mask);
+
+        x = _mm256_sub_pd(x, fx);
+        y = _mm256_sub_pd(y, fy);
+        z = _mm256_sub_pd(z, fz);
+
+        const __m256d u = fade4(x), v = fade4(y), w = fade4(z);
+
+        const __m128i a = _mm_add_epi32(perm4(xi), yi);
+        const __m128i aa = _mm_add_epi32(perm4(a), zi);
+        const __m128i ab = _mm_add_epi32(perm4(_mm_add_epi32(a, one)), zi);
+        const __m128i b = _mm_add_epi32(perm4(_mm_add_epi32(xi, one)), yi);
+        const __m128i ba = _mm_add_epi32(perm4(b), zi);
+        const __m128i bb = _mm_add_epi32(perm4(_mm_add_epi32(b, one)), zi);
+
+        const __m256d c1 = _mm256_set1_pd(1);
+        const __m256d x1 = _mm256_sub_pd(x, c1), y1 = _mm256_sub_pd(y, c1), z1 = _mm256_sub_pd(z, c1);
+
+        return lerp4(w, lerp4(v, lerp4(u, grad4(perm4(aa), x, y, z),
+                                          grad4(perm4(ba), x1, y, z)),
+                                 lerp4(u, grad4(perm4(ab), x, y1, z),
+                                          grad4(perm4(bb), x1, y1, z))),
+                        lerp4(v, lerp4(u, grad4(perm4(_mm_add_epi32(aa, one)), x, y, z1),
+                                          grad4(perm4(_mm_add_epi32(ba, one)), x1, y, z1)),
+                                 lerp4(u, grad4(perm4(_mm_add_epi32(ab, one)), x, y1, z1),
+                                          grad4(perm4(_mm_add_epi32(bb, one)), x1, y1, z1))));
+    }
+#endif // CGLIB_AVX2
+
+#ifdef CGLIB_AVX512
+    static __m512 fade16(__m512 t) {
+        const __m512 t3 = _mm512_mul_ps(_mm512_mul_ps(t, t), t);
+        const __m512 poly = _mm512_mul_ps(t, _mm512_sub_ps(_mm512_mul_ps(t, _mm512_set1_ps(6)), _mm512_set1_ps(15)));
+        return _mm512_mul_ps(t3, _mm512_add_ps(poly, _mm512_set1_ps(10)));
+    }
+
+    static __m512 lerp16(__m512 t, __m512 a, __m512 b) {
+        return _mm512_add_ps(a, _mm512_mul_ps(t, _mm512_sub_ps(b, a)));
+    }
+
+    static __m512i perm16(__m512i idx) {
+        return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xFFFF, idx, reinterpret_cast<const int*>(p), 4);
+    }
+
+    static __m512 grad16(__m512i hash, __m512 x, __m512 y, __m512 z) {
+        const __m512i h = _mm512_and_si512(hash, _mm512_set1_epi32(0xF));
+        const __mmask16 lt8 = _mm512_cmplt_epi32_mask(h, _mm512_set1_epi32(8));
+        const __mmask16 lt4 = _mm512_cmplt_epi32_mask(h, _mm512_set1_epi32(4));
+        const __mmask16 isX = _mm512_cmpeq_epi32_mask(h, _mm512_set1_epi32(12)) |
+                              _mm512_cmpeq_epi32_mask(h, _mm512_set1_epi32(14));
+
+        const __m512 u = _mm512_mask_blend_ps(lt8, y, x);
+        const __m512 v = _mm512_mask_blend_ps(lt4, _mm512_mask_blend_ps(isX, z, x), y);
+
+        const __m512i signBit = _mm512_set1_epi32(0x80000000);
+        const __m512i signU = _mm512_maskz_mov_epi32(_mm512_test_epi32_mask(h, _mm512_set1_epi32(1)), signBit);
+        const __m512i signV = _mm512_maskz_mov_epi32(_mm512_test_epi32_mask(h, _mm512_set1_epi32(2)), signBit);
+        return _mm512_add_ps(_mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(u), signU)),
+                             _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v), signV)));
+    }
+
+    static __m512 noise16(__m512 x, __m512 y, __m512 z) {
+        // Masked forms with explicit sources, the unmasked intrinsics trip -Wuninitialized on GCC 12
+        const __m512 fx = _mm512_mask_roundscale_ps(x, 0xFFFF, x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        const __m512 fy = _mm512_mask_roundscale_ps(y, 0xFFFF, y, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        const __m512 fz = _mm512_mask_roundscale_ps(z, 0xFFFF, z, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        const __m512i zero = _mm512_setzero_si512();
+        const __m512i mask = _mm512_set1_epi32(255);
+        const __m512i one = _mm512_set1_epi32(1);
+        const __m512i xi = _mm512_and_si512(_mm512_mask_cvttps_epi32(zero, 0xFFFF, fx), mask);
+        const __m512i yi = _mm512_and_si512(_mm512_mask_cvttps_epi32(zero, 0xFFFF, fy), mask);
+        const __m512i zi = _mm512_and_si512(_mm512_mask_cvttps_epi32(zero, 0xFFFF, fz), mask);
+
+        x = _mm512_sub_ps(x, fx);
+        y = _mm512_sub_ps(y, fy);
+        z = _mm512_sub_ps(z, fz);
+
+        const __m512 u = fade16(x), v = fade16(y), w = fade16(z);
+
+        const __m512i a = _mm512_add_epi32(perm16(xi), yi);
+        const __m512i aa = _mm512_add_epi32(perm16(a), zi);
+        const __m512i ab = _mm512_add_epi32(perm16(_mm512_add_epi32(a, one)), zi);
+        const __m512i b = _mm512_add_epi32(perm16(_mm512_add_epi32(xi, one)), yi);
+        const __m512i ba = _mm512_add_epi32(perm16(b), zi);
+        const __m512i bb = _mm512_add_epi32(perm16(_mm512_add_epi32(b, one)), zi);
+
+        const __m512 c1 = _mm512_set1_ps(1);
+        const __m512 x1 = _mm512_sub_ps(x, c1), y1 = _mm512_sub_ps(y, c1), z1 = _mm512_sub_ps(z, c1);
+
+        return lerp16(w, lerp16(v, lerp16(u, grad16(perm16(aa), x, y, z),
+                                             grad16(perm16(ba), x1, y, z)),
+                                   lerp16(u, grad16(perm16(ab), x, y1, z),
+                                             grad16(perm16(bb), x1, y1, z))),
+                         lerp16(v, lerp16(u, grad16(perm16(_mm512_add_epi32(aa, one)), x, y, z1),
+                                             grad16(perm16(_mm512_add_epi32(ba, one)), x1, y, z1)),
+                                   lerp16(u, grad16(perm16(_mm512_add_epi32(ab, one)), x, y1, z1),
+                                             grad16(perm16(_mm512_add_epi32(bb, one)), x1, y1, z1))));
+    }
+#endif // CGLIB_AVX512
+
 public:
 
     static T noise(T x, T y, T z) {
@@ -99,6 +308,76 @@ public:
         return total / maxValue;
     }
 
+    /**
+     * Evaluates noise(xs[i], ys[i], zs[i]) for n samples, 16/8 (float32) or 4 (float64) at a time when AVX-512/AVX2
+     * are available. Results are the same as the scalar version.
+     */
+    static void noise(const T* xs, const T* ys, const T* zs, T* out, uint64 n) {
+        uint64 i = 0;
+
+        if constexpr (std::is_same<T, float32>::value && std::is_same<S, int32>::value) {
+#ifdef CGLIB_AVX512
+            for (; i + 16 <= n; i += 16) {
+                _mm512_storeu_ps(out + i, noise16(_mm512_loadu_ps(xs + i), _mm512_loadu_ps(ys + i), _mm512_loadu_ps(zs + i)));
+            }
+#endif
+#ifdef CGLIB_AVX2
+            for (; i + 8 <= n; i += 8) {
+                _mm256_storeu_ps(out + i, noise8(_mm256_loadu_ps(xs + i), _mm256_loadu_ps(ys + i), _mm256_loadu_ps(zs + i)));
+            }
+#endif
+        } else if constexpr (std::is_same<T, float64>::value && std::is_same<S, int32>::value) {
+#ifdef CGLIB_AVX2
+            for (; i + 4 <= n; i += 4) {
+                _mm256_storeu_pd(out + i, noise4(_mm256_loadu_pd(xs + i), _mm256_loadu_pd(ys + i), _mm256_loadu_pd(zs + i)));
+            }
+#endif
+        }
+
+        for (; i < n; i++) {
+            out[i] = noise(xs[i], ys[i], zs[i]);
+        }
+    }
+
+    /**
+     * Batch version of noiseOctaves, see noise(const T*, const T*, const T*, T*, uint64).
+     */
+    static void noiseOctaves(const T* xs, const T* ys, const T* zs, T* out, uint64 n,
+                             uint16 numOctaves, T persistence, T lacunarity) {
+        constexpr uint64 BLOCK = 256;
+        T x[BLOCK], y[BLOCK], z[BLOCK], sample[BLOCK], total[BLOCK];
+
+        for (uint64 begin = 0; begin < n; begin += BLOCK) {
+            const uint64 count = std::min(BLOCK, n - begin);
+            std::fill(total, total + count, T(0));
+
+            T frequency = 1;
+            T amplitude = 1;
+            T maxValue = 0;
+            for (uint16 o = 0; o < numOctaves; o++) {
+                for (uint64 i = 0; i < count; i++) {
+                    x[i] = xs[begin + i] * frequency;
+                    y[i] = ys[begin + i] * frequency;
+                    z[i] = zs[begin + i] * frequency;
+                }
+
+                cglib::PerlinNoise<T, S>::noise(x, y, z, sample, count);
+
+                for (uint64 i = 0; i < count; i++) {
+                    total[i] += ((sample[i] + 1) / 2) * amplitude;
+                }
+                maxValue += amplitude;
+
+                amplitude *= persistence;
+                frequency *= lacunarity;
+            }
+
+            for (uint64 i = 0; i < count; i++) {
+                out[begin + i] = total[i] / maxValue;
+            }
+        }
+    }
+
 };
 
 }; // namespace cglib
@@ -120,11 +120,11 @@ public:
         glUniform1f(glGetUniformLocation(id, name.c_str()), value);
     }
 
-    void setMat4(const std::string& name, Mat4<float32>& m4) const {
+    void setMat4(const std::string& name, const Mat4<float32>& m4) const {
         glUniformMatrix4fv(glGetUniformLocation(id, name.c_str()), 1, GL_TRUE, m4.getPtr());
     }
 
-    void setMat3(const std::string& name, Mat3<float32>& m3) const {
+    void setMat3(const std::string& name, const Mat3<float32>& m3) const {
         glUniformMatrix3fv(glGetUniformLocation(id, name.c_str()), 1, GL_TRUE, m3.getPtr());
     }
 
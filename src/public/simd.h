@@ -0,0 +1,474 @@
+#pragma once
+
+#include "core_types.h"
+
+#include <utility>
+
+// SIMD kernels used by the tensor structures. Every kernel has a scalar template fallback,
+// non-template overloads for float32/float64 are picked up whenever the instruction set is available.
+// Define CGLIB_NO_SIMD to force the scalar paths.
+#if !defined(CGLIB_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+    #define CGLIB_SSE
+    #include <immintrin.h>
+#endif
+
+#if defined(CGLIB_SSE) && defined(__AVX__)
+    #define CGLIB_AVX
+#endif
+
+#if defined(CGLIB_AVX) && defined(__AVX2__)
+    #define CGLIB_AVX2
+#endif
+
+#if defined(CGLIB_AVX2) && defined(__AVX512F__)
+    #define CGLIB_AVX512
+#endif
+
+namespace cglib {
+namespace simd {
+
+/**
+ * Row-major 4x4 matrix product: out = a * b.
+ * out must not alias a or b. The SIMD overloads expect the Mat4 alignment (one row per register).
+ */
+template <typename T>
+inline void mat4Dot(const T* a, const T* b, T* out) {
+    for (uint8 i = 0; i < 4; i++) {
+        const T* row = a + (i << 2);
+        for (uint8 j = 0; j < 4; j++) {
+            out[(i << 2) + j] = row[0]*b[j] + row[1]*b[4 + j] + row[2]*b[8 + j] + row[3]*b[12 + j];
+        }
+    }
+}
+
+#ifdef CGLIB_SSE
+
+inline void mat4Dot(const float32* a, const float32* b, float32* out) {
+    const __m128 b0 = _mm_load_ps(b);
+    const __m128 b1 = _mm_load_ps(b + 4);
+    const __m128 b2 = _mm_load_ps(b + 8);
+    const __m128 b3 = _mm_load_ps(b + 12);
+
+    for (uint8 i = 0; i < 16; i += 4) {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(a[i]), b0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i + 1]), b1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i + 2]), b2));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i + 3]), b3));
+        _mm_store_ps(out + i, row);
+    }
+}
+
+#ifdef CGLIB_AVX
+
+inline void mat4Dot(const float64* a, const float64* b, float64* out) {
+    const __m256d b0 = _mm256_load_pd(b);
+    const __m256d b1 = _mm256_load_pd(b + 4);
+    const __m256d b2 = _mm256_load_pd(b + 8);
+    const __m256d b3 = _mm256_load_pd(b + 12);
+
+    for (uint8 i = 0; i < 16; i += 4) {
+        __m256d row = _mm256_mul_pd(_mm256_set1_pd(a[i]), b0);
+        row = _mm256_add_pd(row, _mm256_mul_pd(_mm256_set1_pd(a[i + 1]), b1));
+        row = _mm256_add_pd(row, _mm256_mul_pd(_mm256_set1_pd(a[i + 2]), b2));
+        row = _mm256_add_pd(row, _mm256_mul_pd(_mm256_set1_pd(a[i + 3]), b3));
+        _mm256_store_pd(out + i, row);
+    }
+}
+
+#else
+
+// Without AVX each float64 row is split in two SSE2 halves
+inline void mat4Dot(const float64* a, const float64* b, float64* out) {
+    for (uint8 h = 0; h < 4; h += 2) {
+        const __m128d b0 = _mm_load_pd(b + h);
+        const __m128d b1 = _mm_load_pd(b + 4 + h);
+        const __m128d b2 = _mm_load_pd(b + 8 + h);
+        const __m128d b3 = _mm_load_pd(b + 12 + h);
+
+        for (uint8 i = 0; i < 16; i += 4) {
+            __m128d row = _mm_mul_pd(_mm_set1_pd(a[i]), b0);
+            row = _mm_add_pd(row, _mm_mul_pd(_mm_set1_pd(a[i + 1]), b1));
+            row = _mm_add_pd(row, _mm_mul_pd(_mm_set1_pd(a[i + 2]), b2));
+            row = _mm_add_pd(row, _mm_mul_pd(_mm_set1_pd(a[i + 3]), b3));
+            _mm_store_pd(out + i + h, row);
+        }
+    }
+}
+
+#endif // CGLIB_AVX
+
+#endif // CGLIB_SSE
+
+/**
+ * General 4x4 inverse (cofactor expansion). A singular m yields non finite values.
+ */
+template <typename T>
+inline void mat4Inverse(const T* m, T* out) {
+    T inv[16];
+
+    inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+    inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+    inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+    inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+    inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+    inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+    inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+    inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+
+    const T invDet = 1 / (m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12]);
+    for (uint8 i = 0; i < 16; i++) {
+        out[i] = inv[i] * invDet;
+    }
+}
+
+/**
+ * Inverse of an affine matrix (any invertible upper 3x3, last row 0 0 0 1).
+ */
+template <typename T>
+inline void mat4AffineInverse(const T* m, T* out) {
+    // Columns of the inverse 3x3 are the cross products of the rows
+    const T c0[3] = {m[5]*m[10] - m[6]*m[9], m[6]*m[8] - m[4]*m[10], m[4]*m[9] - m[5]*m[8]};
+    const T c1[3] = {m[9]*m[2] - m[10]*m[1], m[10]*m[0] - m[8]*m[2], m[8]*m[1] - m[9]*m[0]};
+    const T c2[3] = {m[1]*m[6] - m[2]*m[5], m[2]*m[4] - m[0]*m[6], m[0]*m[5] - m[1]*m[4]};
+    const T invDet = 1 / (m[0]*c0[0] + m[1]*c0[1] + m[2]*c0[2]);
+
+    for (uint8 i = 0; i < 3; i++) {
+        const T r0 = c0[i] * invDet, r1 = c1[i] * invDet, r2 = c2[i] * invDet;
+        T* row = out + (i << 2);
+        row[0] = r0; row[1] = r1; row[2] = r2;
+        row[3] = -(r0*m[3] + r1*m[7] + r2*m[11]);
+    }
+    out[12] = 0; out[13] = 0; out[14] = 0; out[15] = 1;
+}
+
+/**
+ * Inverse of a rotation + translation matrix: the rotation is transposed instead of inverted.
+ */
+template <typename T>
+inline void mat4RigidInverse(const T* m, T* out) {
+    for (uint8 i = 0; i < 3; i++) {
+        T* row = out + (i << 2);
+        row[0] = m[i]; row[1] = m[4 + i]; row[2] = m[8 + i];
+        row[3] = -(m[i]*m[3] + m[4 + i]*m[7] + m[8 + i]*m[11]);
+    }
+    out[12] = 0; out[13] = 0; out[14] = 0; out[15] = 1;
+}
+
+#ifdef CGLIB_SSE
+
+namespace detail {
+
+template <int X, int Y, int Z, int W>
+inline __m128 swizzle(__m128 v) {
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X));
+}
+
+// 2x2 row-major blocks packed as (m00, m01, m10, m11)
+inline __m128 mat2Mul(__m128 a, __m128 b) {
+    return _mm_add_ps(_mm_mul_ps(a, swizzle<0, 3, 0, 3>(b)),
+                      _mm_mul_ps(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+}
+
+// adj(a) * b
+inline __m128 mat2AdjMul(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(swizzle<3, 3, 0, 0>(a), b),
+                      _mm_mul_ps(swizzle<1, 1, 2, 2>(a), swizzle<2, 3, 0, 1>(b)));
+}
+
+// a * adj(b)
+inline __m128 mat2MulAdj(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(a, swizzle<3, 0, 3, 0>(b)),
+                      _mm_mul_ps(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+}
+
+inline __m128 cross(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(swizzle<1, 2, 0, 3>(a), swizzle<2, 0, 1, 3>(b)),
+                      _mm_mul_ps(swizzle<2, 0, 1, 3>(a), swizzle<1, 2, 0, 3>(b)));
+}
+
+inline __m128 horizontalSum(__m128 v) {
+    v = _mm_add_ps(v, swizzle<1, 0, 3, 2>(v));
+    return _mm_add_ps(v, swizzle<2, 3, 0, 1>(v));
+}
+
+inline __m128 horizontalMin(__m128 v) {
+    v = _mm_min_ps(v, swizzle<1, 0, 3, 2>(v));
+    return _mm_min_ps(v, swizzle<2, 3, 0, 1>(v));
+}
+
+inline __m128 horizontalMax(__m128 v) {
+    v = _mm_max_ps(v, swizzle<1, 0, 3, 2>(v));
+    return _mm_max_ps(v, swizzle<2, 3, 0, 1>(v));
+}
+
+}; // namespace detail
+
+// Block-wise inverse on the four 2x2 sub-matrices
+inline void mat4Inverse(const float32* m, float32* out) {
+    using namespace detail;
+
+    const __m128 r0 = _mm_load_ps(m);
+    const __m128 r1 = _mm_load_ps(m + 4);
+    const __m128 r2 = _mm_load_ps(m + 8);
+    const __m128 r3 = _mm_load_ps(m + 12);
+
+    const __m128 A = _mm_movelh_ps(r0, r1);
+    const __m128 B = _mm_movehl_ps(r1, r0);
+    const __m128 C = _mm_movelh_ps(r2, r3);
+    const __m128 D = _mm_movehl_ps(r3, r2);
+
+    // (|A|, |B|, |C|, |D|)
+    const __m128 detSub = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0)))
+    );
+    const __m128 detA = swizzle<0, 0, 0, 0>(detSub);
+    const __m128 detB = swizzle<1, 1, 1, 1>(detSub);
+    const __m128 detC = swizzle<2, 2, 2, 2>(detSub);
+    const __m128 detD = swizzle<3, 3, 3, 3>(detSub);
+
+    const __m128 DC = mat2AdjMul(D, C);
+    const __m128 AB = mat2AdjMul(A, B);
+
+    __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), mat2Mul(B, DC));
+    __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), mat2Mul(C, AB));
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), mat2MulAdj(D, AB));
+    __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), mat2MulAdj(A, DC));
+
+    // |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+    const __m128 trace = horizontalSum(_mm_mul_ps(AB, swizzle<0, 2, 1, 3>(DC)));
+    const __m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+    const __m128 invDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+
+    X = _mm_mul_ps(X, invDetM);
+    Y = _mm_mul_ps(Y, invDetM);
+    Z = _mm_mul_ps(Z, invDetM);
+    W = _mm_mul_ps(W, invDetM);
+
+    _mm_store_ps(out, _mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_store_ps(out + 4, _mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+    _mm_store_ps(out + 8, _mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_store_ps(out + 12, _mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
+}
+
+inline void mat4AffineInverse(const float32* m, float32* out) {
+    using namespace detail;
+
+    const __m128 a = _mm_load_ps(m);
+    const __m128 b = _mm_load_ps(m + 4);
+    const __m128 c = _mm_load_ps(m + 8);
+
+    // Columns of the inverse 3x3, the w lanes are zero
+    __m128 c0 = cross(b, c);
+    __m128 c1 = cross(c, a);
+    __m128 c2 = cross(a, b);
+    const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), horizontalSum(_mm_mul_ps(a, c0)));
+    c0 = _mm_mul_ps(c0, invDet);
+    c1 = _mm_mul_ps(c1, invDet);
+    c2 = _mm_mul_ps(c2, invDet);
+
+    const __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, swizzle<3, 3, 3, 3>(a)),
+                                           _mm_mul_ps(c1, swizzle<3, 3, 3, 3>(b))),
+                                _mm_mul_ps(c2, swizzle<3, 3, 3, 3>(c)));
+    __m128 r3 = _mm_sub_ps(_mm_setzero_ps(), t);
+
+    _MM_TRANSPOSE4_PS(c0, c1, c2, r3);
+
+    _mm_store_ps(out, c0);
+    _mm_store_ps(out + 4, c1);
+    _mm_store_ps(out + 8, c2);
+    _mm_store_ps(out + 12, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+inline void mat4RigidInverse(const float32* m, float32* out) {
+    using namespace detail;
+
+    __m128 a = _mm_load_ps(m);
+    __m128 b = _mm_load_ps(m + 4);
+    __m128 c = _mm_load_ps(m + 8);
+
+    const __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, swizzle<3, 3, 3, 3>(a)),
+                                           _mm_mul_ps(b, swizzle<3, 3, 3, 3>(b))),
+                                _mm_mul_ps(c, swizzle<3, 3, 3, 3>(c)));
+    // Only the xyz lanes of t are meaningful, the w lane is dropped by the transpose below
+    __m128 r3 = _mm_sub_ps(_mm_setzero_ps(), t);
+
+    // Zero the translation lanes so that they do not leak into the transposed rotation
+    const __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    a = _mm_and_ps(a, xyzMask);
+    b = _mm_and_ps(b, xyzMask);
+    c = _mm_and_ps(c, xyzMask);
+
+    _MM_TRANSPOSE4_PS(a, b, c, r3);
+
+    _mm_store_ps(out, a);
+    _mm_store_ps(out + 4, b);
+    _mm_store_ps(out + 8, c);
+    _mm_store_ps(out + 12, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+#endif // CGLIB_SSE
+
+/**
+ * Applies the affine part of the row-major matrix m to n points stored as separate x, y, z arrays.
+ * The last row of m is assumed to be (0, 0, 0, 1). Output arrays must not alias the inputs.
+ */
+template <typename T>
+inline void transformPointsSoA(const T* m, const T* xs, const T* ys, const T* zs,
+                               T* outX, T* outY, T* outZ, uint64 n) {
+    for (uint64 i = 0; i < n; i++) {
+        const T x = xs[i], y = ys[i], z = zs[i];
+        outX[i] = m[0]*x + m[1]*y + m[2]*z + m[3];
+        outY[i] = m[4]*x + m[5]*y + m[6]*z + m[7];
+        outZ[i] = m[8]*x + m[9]*y + m[10]*z + m[11];
+    }
+}
+
+#ifdef CGLIB_SSE
+
+inline void transformPointsSoA(const float32* m, const float32* xs, const float32* ys, const float32* zs,
+                               float32* outX, float32* outY, float32* outZ, uint64 n) {
+    uint64 i = 0;
+
+#ifdef CGLIB_AVX
+    __m256 r[12];
+    for (uint8 j = 0; j < 12; j++) {
+        r[j] = _mm256_set1_ps(m[j]);
+    }
+
+    for (; i + 8 <= n; i += 8) {
+        const __m256 x = _mm256_loadu_ps(xs + i);
+        const __m256 y = _mm256_loadu_ps(ys + i);
+        const __m256 z = _mm256_loadu_ps(zs + i);
+
+        for (uint8 row = 0; row < 3; row++) {
+            const __m256* c = r + (row << 2);
+            __m256 acc = _mm256_add_ps(_mm256_mul_ps(c[0], x), _mm256_mul_ps(c[1], y));
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(c[2], z));
+            acc = _mm256_add_ps(acc, c[3]);
+            _mm256_storeu_ps((row == 0 ? outX : row == 1 ? outY : outZ) + i, acc);
+        }
+    }
+#endif
+
+    __m128 q[12];
+    for (uint8 j = 0; j < 12; j++) {
+        q[j] = _mm_set1_ps(m[j]);
+    }
+
+    for (; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_loadu_ps(xs + i);
+        const __m128 y = _mm_loadu_ps(ys + i);
+        const __m128 z = _mm_loadu_ps(zs + i);
+
+        for (uint8 row = 0; row < 3; row++) {
+            const __m128* c = q + (row << 2);
+            __m128 acc = _mm_add_ps(_mm_mul_ps(c[0], x), _mm_mul_ps(c[1], y));
+            acc = _mm_add_ps(acc, _mm_mul_ps(c[2], z));
+            acc = _mm_add_ps(acc, c[3]);
+            _mm_storeu_ps((row == 0 ? outX : row == 1 ? outY : outZ) + i, acc);
+        }
+    }
+
+    transformPointsSoA<float32>(m, xs + i, ys + i, zs + i, outX + i, outY + i, outZ + i, n - i);
+}
+
+#endif // CGLIB_SSE
+
+/**
+ * Slab test of the ray origin + t * direction, t in [0, tMax], against the box [boundsMin, boundsMax].
+ * invDirection holds the reciprocals of the direction components. On hit tNear is the entry distance.
+ * The float32 overload reads four values from every pointer and ignores the fourth one.
+ */
+template <typename T>
+inline bool rayBox(const T* boundsMin, const T* boundsMax, const T* origin, const T* invDirection, T tMax, T& tNear) {
+    T tFar = tMax;
+    tNear = 0;
+    for (uint8 i = 0; i < 3; i++) {
+        T t0 = (boundsMin[i] - origin[i]) * invDirection[i];
+        T t1 = (boundsMax[i] - origin[i]) * invDirection[i];
+        if (t0 > t1) std::swap(t0, t1);
+        tNear = t0 > tNear ? t0 : tNear;
+        tFar = t1 < tFar ? t1 : tFar;
+    }
+    return tNear <= tFar;
+}
+
+/**
+ * Whether the boxes [aMin, aMax] and [bMin, bMax] intersect, touching counts.
+ * The float32 overload reads four values from every pointer and ignores the fourth one.
+ */
+template <typename T>
+inline bool boxOverlap(const T* aMin, const T* aMax, const T* bMin, const T* bMax) {
+    return aMin[0] <= bMax[0] && bMin[0] <= aMax[0] &&
+           aMin[1] <= bMax[1] && bMin[1] <= aMax[1] &&
+           aMin[2] <= bMax[2] && bMin[2] <= aMax[2];
+}
+
+#ifdef CGLIB_SSE
+
+inline bool rayBox(const float32* boundsMin, const float32* boundsMax, const float32* origin, const float32* invDirection,
+                   float32 tMax, float32& tNear) {
+    using namespace detail;
+
+    const __m128 o = _mm_loadu_ps(origin);
+    const __m128 inv = _mm_loadu_ps(invDirection);
+    const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boundsMin), o), inv);
+    const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boundsMax), o), inv);
+
+    // Replace the unused fourth lane by the first one so that it does not take part in the reductions
+    const __m128 near = swizzle<0, 1, 2, 0>(_mm_min_ps(t0, t1));
+    const __m128 far = swizzle<0, 1, 2, 0>(_mm_max_ps(t0, t1));
+
+    const __m128 enter = _mm_max_ss(horizontalMax(near), _mm_setzero_ps());
+    const __m128 exit = _mm_min_ss(horizontalMin(far), _mm_set_ss(tMax));
+    tNear = _mm_cvtss_f32(enter);
+    return _mm_comile_ss(enter, exit);
+}
+
+inline bool boxOverlap(const float32* aMin, const float32* aMax, const float32* bMin, const float32* bMax) {
+    const __m128 separated = _mm_or_ps(_mm_cmpgt_ps(_mm_loadu_ps(aMin), _mm_loadu_ps(bMax)),
+                                       _mm_cmpgt_ps(_mm_loadu_ps(bMin), _mm_loadu_ps(aMax)));
+    return (_mm_movemask_ps(separated) & 0x7) == 0;
+}
+
+#endif // CGLIB_SSE
+
+/**
+ * 2x2 box filter over two rows of 4 component pixels: out[x] is the average of pixels 2x and 2x+1 of rows a and b.
+ * pairStride is the offset of the second pixel of each pair, 4 or 0 when the source rows have a single pixel.
+ */
+template <typename T>
+inline void boxFilter2x2(const T* a, const T* b, T* out, uint64 count, uint64 pairStride) {
+    for (uint64 x = 0; x < count; x++) {
+        const T* pa = a + 8 * x;
+        const T* pb = b + 8 * x;
+        for (uint8 c = 0; c < 4; c++) {
+            out[4 * x + c] = (pa[c] + pa[c + pairStride] + pb[c] + pb[c + pairStride]) * T(0.25);
+        }
+    }
+}
+
+#ifdef CGLIB_SSE
+
+inline void boxFilter2x2(const float32* a, const float32* b, float32* out, uint64 count, uint64 pairStride) {
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for (uint64 x = 0; x < count; x++) {
+        const __m128 top = _mm_add_ps(_mm_loadu_ps(a + 8 * x), _mm_loadu_ps(a + 8 * x + pairStride));
+        const __m128 bottom = _mm_add_ps(_mm_loadu_ps(b + 8 * x), _mm_loadu_ps(b + 8 * x + pairStride));
+        _mm_storeu_ps(out + 4 * x, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+    }
+}
+
+#endif // CGLIB_SSE
+
+}; // namespace simd
+}; // namespace cglib
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "core_types.h"
+
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Non owning view over a contiguous array, whoever creates it keeps the memory alive.
+ */
+template <typename T>
+class Span {
+private:
+    T* ptr = nullptr;
+    uint64 count = 0;
+
+public:
+    Span() {}
+
+    Span(T* data, uint64 size) : ptr(data), count(size) {}
+
+    template <typename U>
+    Span(std::vector<U>& v) : ptr(v.data()), count(v.size()) {}
+
+    template <typename U>
+    Span(const std::vector<U>& v) : ptr(v.data()), count(v.size()) {}
+
+    T* data() const {
+        return ptr;
+    }
+
+    uint64 size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    T& operator[](uint64 i) const {
+        return ptr[i];
+    }
+
+    T* begin() const {
+        return ptr;
+    }
+
+    T* end() const {
+        return ptr + count;
+    }
+};
+
+}; // namespace cglib
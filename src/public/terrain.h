@@ -5,94 +5,141 @@
 #include "vector"
 #include "vec3.h"
 #include "perlin.h"
+#include "heightfield.h"
+#include "terrain_lod.h"
+#include "height_grid.h"
+#include <algorithm>
 
 namespace cglib {
 
 class Terrain {
 private:
-    uint32 VAO, VBO, EBO;
+    struct Patch {
+        uint32 baseVertex;
+        Vec3<float32> boundsMin, boundsMax;
+    };
+
+    uint32 VAO, VBO;
     std::vector<float32> vertices;
-    std::vector<uint32> indices;
     std::vector<Vec3<float32>> normals;
 
     uint32 GridSize;
     const uint32 TileSize;
-    std::vector<std::vector<float32>> height;
+
+    // Samples per side and their heights
+    uint32 numSamples;
+    HeightGrid<float32> height;
+
+    // The grid is drawn as patches of PatchSize quads per side, each with its own level of detail.
+    // Patches on the far border may stick out of the grid, their extra vertices collapse on the last sample.
+    // A patchSize of 0 is raised to 1.
+    const uint32 PatchSize;
+    uint32 numPatches;
+    std::vector<Patch> patches;
+    TerrainLod lod;
 
     // TODO remove and use textures
     uint32 colorVBO;
     std::vector<float32> colors;
 
-
-
 public:
-    Terrain(uint32 size, uint32 tileSize) : GridSize(size), TileSize(tileSize) {
+    Terrain(uint32 size, uint32 tileSize, uint32 patchSize = 32)
+    : Terrain(size, tileSize, generateHeights(size, tileSize), patchSize) {}
+
+    /**
+     * Builds the terrain from heights produced by generateHeights, which can run away from the GL thread.
+     */
+    Terrain(uint32 size, uint32 tileSize, std::vector<float32>&& heights, uint32 patchSize = 32)
+    : GridSize(size), TileSize(tileSize), numSamples((size + tileSize - 1) / tileSize), height(numSamples, numSamples, std::move(heights)),
+      PatchSize(std::max(patchSize, 1u)), lod(PatchSize) {
+        numPatches = std::max(1u, (numSamples - 1 + PatchSize - 1) / PatchSize);
         createGrid();
-        createIndices();
         setup();
     }
 
+    static std::vector<float32> generateHeights(uint32 size, uint32 tileSize, ThreadPool& pool = ThreadPool::global()) {
+        const uint32 samples = (size + tileSize - 1) / tileSize;
+        const HeightfieldGenerator<float32> generator(size, 10, 3, 0.3, 4);
+        return generator.generate(samples, samples, 0, 0, tileSize, pool);
+    }
+
     void calculateNormals() {
         // TODO - first refactor using Vertex!!
     }
 
     void createGrid() {
-        vertices = std::vector<float32>((GridSize * GridSize / TileSize*TileSize) * 3);
-        colors = std::vector<float32>((GridSize * GridSize / TileSize*TileSize) * 3);
-        height = std::vector(GridSize, std::vector<float32>(GridSize));
-
-        uint64 curr = 0;
-        uint64 colorCurr = 0;
-
-        for (uint16 i = 0; i < GridSize; i += TileSize) {
-            for (uint16 j = 0; j < GridSize; j += TileSize) {
-                float32 generatedHeight = 10*cglib::PerlinNoise<float32>::noiseOctaves(static_cast<float32>(i) / GridSize, static_cast<float32>(j) / GridSize, 0, 3, 0.3, 4);
-                height[i][j] = generatedHeight;
-                vertices[curr++] = i;
-                vertices[curr++] = generatedHeight;
-                vertices[curr++] = j;
-
-                if (generatedHeight <= 4*2) {
-                    colors[colorCurr++] = 0.0f;
-                    colors[colorCurr++] = 1.0f;
-                    colors[colorCurr++] = 1.0f;
-                } else {
-                    colors[colorCurr++] = 0.0f;
-                    colors[colorCurr++] = 1.0f;
-                    colors[colorCurr++] = 0.0f;
+        const uint32 perPatch = TerrainLod::verticesPerPatch(PatchSize);
+        const uint32 gridVertices = (PatchSize + 1) * (PatchSize + 1);
+        vertices = std::vector<float32>(static_cast<uint64>(numPatches) * numPatches * perPatch * 3);
+        colors = std::vector<float32>(vertices.size());
+        patches = std::vector<Patch>(numPatches * numPatches);
+
+        ThreadPool::global().parallelFor(0, patches.size(), 16, [&](uint64 begin, uint64 end) {
+            for (uint64 p = begin; p < end; p++) {
+                const uint32 pi = (p / numPatches) * PatchSize, pj = (p % numPatches) * PatchSize;
+                Patch& patch = patches[p];
+                patch.baseVertex = p * perPatch;
+
+                float32 minHeight = height.at(pi, pj), maxHeight = minHeight;
+                for (uint32 i = 0; i <= PatchSize; i++) {
+                    for (uint32 j = 0; j <= PatchSize; j++) {
+                        const float32 h = height.at(pi + i, pj + j);
+                        minHeight = std::min(minHeight, h);
+                        maxHeight = std::max(maxHeight, h);
+                    }
+                }
+                const float32 skirtDepth = maxHeight - minHeight + TileSize;
+
+                for (uint32 k = 0; k < perPatch; k++) {
+                    uint32 i, j;
+                    if (k < gridVertices) {
+                        i = k / (PatchSize + 1);
+                        j = k % (PatchSize + 1);
+                    } else {
+                        TerrainLod::skirtSource(PatchSize, k - gridVertices, i, j);
+                    }
+
+                    const uint32 gi = std::min(pi + i, numSamples - 1), gj = std::min(pj + j, numSamples - 1);
+                    const float32 generatedHeight = height(gi, gj);
+                    const uint64 idx = (static_cast<uint64>(patch.baseVertex) + k) * 3;
+
+                    vertices[idx] = gi * TileSize;
+                    vertices[idx + 1] = k < gridVertices ? generatedHeight : generatedHeight - skirtDepth;
+                    vertices[idx + 2] = gj * TileSize;
+
+                    colors[idx] = 0.0f;
+                    colors[idx + 1] = 1.0f;
+                    colors[idx + 2] = generatedHeight <= 4*2 ? 1.0f : 0.0f;
                 }
+
+                patch.boundsMin = {static_cast<float32>(pi * TileSize), minHeight, static_cast<float32>(pj * TileSize)};
+                patch.boundsMax = {static_cast<float32>(std::min(pi + PatchSize, numSamples - 1) * TileSize), maxHeight,
+                                   static_cast<float32>(std::min(pj + PatchSize, numSamples - 1) * TileSize)};
             }
-        }
+        });
     }
 
     float32 getHeight(uint32 x, uint32 z) {
         if (x < 0 || x >= GridSize || z < 0 || z >= GridSize) {
             return 0;
         }
-        return height[x][z];
+        return height(x / TileSize, z / TileSize);
     }
 
-    void createIndices() {
-        uint64 j = 0;
-        for (uint64 i = 0; i < (GridSize/TileSize) - 1; i++) {
-            while (true) {
-                indices.push_back(j); indices.push_back(j+1); indices.push_back(j + (GridSize/TileSize));
-                indices.push_back(j+1); indices.push_back(j+ (GridSize/TileSize) +1); indices.push_back(j+ (GridSize/TileSize));
-
-                if (j == (GridSize/TileSize) *(i+1) - 2) {
-                    j+=2;
-                    break;
-                } else {
-                    j++;
-                }
-            }
-        }
+    /**
+     * Height at any point of the terrain, bilinearly interpolated between samples.
+     */
+    float32 getHeight(float32 x, float32 z) const {
+        return height.bilinear(x / TileSize, z / TileSize);
+    }
+
+    const HeightGrid<float32>& getHeightGrid() const {
+        return height;
     }
 
     void setup() {
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
         glGenBuffers(1, &colorVBO);
 
         glBindVertexArray(VAO);
@@ -102,23 +149,39 @@ public:
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float32), (void*)0);
         glEnableVertexAttribArray(0);
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(uint32), indices.data(), GL_STATIC_DRAW);
+        lod.bind();
 
         glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
         glBufferData(GL_ARRAY_BUFFER, colors.size()*sizeof(float32), colors.data(), GL_STATIC_DRAW);
 
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float32), (void*)0);
         glEnableVertexAttribArray(1);
+
+        glBindVertexArray(0);
     }
 
+    /**
+     * Draws every patch at full resolution.
+     */
     void draw() {
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        for (const Patch& patch : patches) {
+            lod.draw(0, patch.baseVertex);
+        }
         glBindVertexArray(0);
     }
 
-
+    /**
+     * Draws each patch at the level of detail matching its on screen size as seen from viewPosition.
+     */
+    void draw(const Vec3<float32>& viewPosition, const Mat4<float32>& projection, float32 viewportHeight) {
+        glBindVertexArray(VAO);
+        for (const Patch& patch : patches) {
+            lod.draw(lod.selectLevel(viewPosition, patch.boundsMin, patch.boundsMax, TileSize, projection, viewportHeight),
+                     patch.baseVertex);
+        }
+        glBindVertexArray(0);
+    }
 };
 
 }; // namespace cglib
\ No newline at end of file
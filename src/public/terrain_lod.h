@@ -0,0 +1,167 @@
+#pragma once
+#include <glad/glad.h>
+#include "core_types.h"
+#include "vec3.h"
+#include "mat4.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Geomipmapping for square terrain patches of patchSize quads per side.
+ *
+ * A patch stores (patchSize + 1)^2 grid vertices (row-major, rows along x) followed by
+ * 4 * (patchSize + 1) skirt vertices, see skirtSource. Level l only uses every 2^l-th grid vertex.
+ * Skirts hang below the patch border and hide the cracks between neighbours drawn at different levels.
+ * One index buffer holds every level and is shared by all the patches.
+ *
+ * This is flat geomipmapping, not a CDLOD quadtree: each patch picks its level on its own (see selectLevel),
+ * callers visit every patch and nothing is culled hierarchically. Transitions rely on skirts, vertices are not
+ * morphed between levels.
+ */
+class TerrainLod {
+private:
+    uint32 PatchSize;
+    uint32 numLevels;
+    float32 targetPixels;
+
+    uint32 EBO;
+    std::vector<uint64> levelOffset;
+    std::vector<uint32> levelCount;
+
+    void pushSkirtQuad(std::vector<uint32>& indices, uint32 a, uint32 b, uint32 sa, uint32 sb) {
+        // Both windings so that skirts are visible from either side with face culling enabled
+        indices.push_back(a); indices.push_back(sa); indices.push_back(b);
+        indices.push_back(b); indices.push_back(sa); indices.push_back(sb);
+        indices.push_back(a); indices.push_back(b); indices.push_back(sa);
+        indices.push_back(b); indices.push_back(sb); indices.push_back(sa);
+    }
+
+public:
+    /**
+     * targetPixels: on screen size a quad should have before switching to the next coarser level.
+     * A patchSize of 0 is reported and raised to 1.
+     */
+    explicit TerrainLod(uint32 patchSize, float32 targetPixels = 8.0f) : PatchSize(patchSize), targetPixels(targetPixels) {
+        if (PatchSize == 0) {
+            std::cout << "ERROR::TERRAIN_LOD:: patch size must be at least 1" << std::endl;
+            PatchSize = 1;
+        }
+
+        // Level l steps 2^l vertices, it must divide the patch size and fit in 32 bits
+        numLevels = 1;
+        while (numLevels < 32 && PatchSize % (1u << numLevels) == 0) {
+            numLevels++;
+        }
+
+        const uint32 samples = PatchSize + 1;
+        const uint32 skirtBase = samples * samples;
+
+        std::vector<uint32> indices;
+        for (uint32 l = 0; l < numLevels; l++) {
+            const uint32 s = 1u << l;
+            levelOffset.push_back(indices.size() * sizeof(uint32));
+
+            for (uint32 i = 0; i < PatchSize; i += s) {
+                for (uint32 j = 0; j < PatchSize; j += s) {
+                    const uint32 v = i * samples + j;
+                    const uint32 right = v + s, down = v + s * samples;
+                    indices.push_back(v); indices.push_back(right); indices.push_back(down);
+                    indices.push_back(right); indices.push_back(down + s); indices.push_back(down);
+                }
+            }
+
+            for (uint32 k = 0; k < PatchSize; k += s) {
+                // Edges i = 0, i = PatchSize, j = 0, j = PatchSize
+                pushSkirtQuad(indices, k, k + s, skirtBase + k, skirtBase + k + s);
+                pushSkirtQuad(indices, PatchSize * samples + k, PatchSize * samples + k + s,
+                              skirtBase + samples + k, skirtBase + samples + k + s);
+                pushSkirtQuad(indices, k * samples, (k + s) * samples,
+                              skirtBase + 2 * samples + k, skirtBase + 2 * samples + k + s);
+                pushSkirtQuad(indices, k * samples + PatchSize, (k + s) * samples + PatchSize,
+                              skirtBase + 3 * samples + k, skirtBase + 3 * samples + k + s);
+            }
+
+            levelCount.push_back(indices.size() - levelOffset.back() / sizeof(uint32));
+        }
+
+        glGenBuffers(1, &EBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(uint32), indices.data(), GL_STATIC_DRAW);
+    }
+
+    ~TerrainLod() {
+        glDeleteBuffers(1, &EBO);
+    }
+
+    TerrainLod(const TerrainLod&) = delete;
+    TerrainLod& operator=(const TerrainLod&) = delete;
+
+    static uint32 verticesPerPatch(uint32 patchSize) {
+        return (patchSize + 1) * (patchSize + 1) + 4 * (patchSize + 1);
+    }
+
+    /**
+     * Grid vertex (i, j) a skirt vertex k is hanging from.
+     */
+    static void skirtSource(uint32 patchSize, uint32 k, uint32& i, uint32& j) {
+        const uint32 samples = patchSize + 1;
+        const uint32 edge = k / samples, t = k % samples;
+        switch (edge) {
+            case 0: i = 0; j = t; break;
+            case 1: i = patchSize; j = t; break;
+            case 2: i = t; j = 0; break;
+            default: i = t; j = patchSize; break;
+        }
+    }
+
+    uint32 getNumLevels() const {
+        return numLevels;
+    }
+
+    /**
+     * Coarsest level whose quads still cover about targetPixels on screen.
+     * Uses the distance from viewPosition to the patch bounds and the vertical focal length of the projection.
+     */
+    uint32 selectLevel(const Vec3<float32>& viewPosition, const Vec3<float32>& boundsMin, const Vec3<float32>& boundsMax,
+                       float32 sampleSpacing, const Mat4<float32>& projection, float32 viewportHeight) const {
+        const float32 dx = std::max({boundsMin.x - viewPosition.x, 0.0f, viewPosition.x - boundsMax.x});
+        const float32 dy = std::max({boundsMin.y - viewPosition.y, 0.0f, viewPosition.y - boundsMax.y});
+        const float32 dz = std::max({boundsMin.z - viewPosition.z, 0.0f, viewPosition.z - boundsMax.z});
+        const float32 distance = std::sqrt(dx*dx + dy*dy + dz*dz);
+
+        const float32 pixelsPerSample = sampleSpacing * projection.y1 * viewportHeight / (2 * std::max(distance, 1e-3f));
+        if (pixelsPerSample >= targetPixels) {
+            return 0;
+        }
+        const uint32 level = static_cast<uint32>(std::log2(targetPixels / pixelsPerSample));
+        return std::min(level, numLevels - 1);
+    }
+
+    /**
+     * Binds the shared index buffer to the currently bound vertex array.
+     */
+    void bind() const {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    }
+
+    /**
+     * Draws the patch whose vertices start at baseVertex in the bound vertex array.
+     */
+    void draw(uint32 level, uint32 baseVertex) const {
+        glDrawElementsBaseVertex(GL_TRIANGLES, levelCount[level], GL_UNSIGNED_INT, (void*)levelOffset[level], baseVertex);
+    }
+
+    /**
+     * Number of triangles drawn at a level, skirts included.
+     */
+    uint32 triangles(uint32 level) const {
+        return levelCount[level] / 3;
+    }
+};
+
+}; // namespace cglib
@@ -2,6 +2,7 @@
 
 #include "core_types.h"
 
+#include <memory>
 #include <string>
 
 namespace cglib {
@@ -9,6 +10,8 @@ struct Texture {
     uint32 id;
     std::string type;
     std::string path;
+    // Keeps the GL texture alive while any copy exists, see TextureCache
+    std::shared_ptr<const uint32> handle;
 };
 
 }; // namespace cglib
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "core_types.h"
+#include "texture_loader.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Process wide registry of the GL textures loaded from files, keyed by normalized path.
+ * Handles are reference counted: the texture is loaded (asynchronously) on the first request and deleted
+ * once the last handle is released, so textures shared by many meshes are decoded and stored only once.
+ * Must be used from the GL thread.
+ */
+class TextureCache {
+public:
+    // Shared GL texture name, the texture is deleted with the last copy
+    using Handle = std::shared_ptr<const uint32>;
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<const uint32>> entries;
+
+    TextureCache() {}
+
+    template <typename F>
+    Handle acquire(const std::string& key, F&& load) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::weak_ptr<const uint32>& entry = entries[key];
+        if (Handle handle = entry.lock()) {
+            return handle;
+        }
+
+        Handle handle(new uint32(load()), [this, key](const uint32* id) {
+            release(key);
+            TextureLoader::deleteTexture(*id);
+            delete id;
+        });
+        entry = handle;
+        return handle;
+    }
+
+    void release(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // The path may have been loaded again since the last handle started releasing
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.expired()) {
+            entries.erase(it);
+        }
+    }
+
+public:
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    static TextureCache& global() {
+        // Never destroyed, handles held by static objects may be released after it would be
+        static TextureCache* cache = new TextureCache();
+        return *cache;
+    }
+
+    /**
+     * Same path for "a\\b.png", "./a//b.png" and "a/c/../b.png".
+     */
+    static std::string normalize(const std::string& path) {
+        std::string unified = path;
+        std::replace(unified.begin(), unified.end(), '\\', '/');
+
+        const bool absolute = !unified.empty() && unified[0] == '/';
+        std::vector<std::string> parts;
+        uint64 begin = 0;
+        while (begin <= unified.size()) {
+            uint64 end = unified.find('/', begin);
+            if (end == std::string::npos) end = unified.size();
+            const std::string part = unified.substr(begin, end - begin);
+
+            if (part == "..") {
+                if (!parts.empty() && parts.back() != "..") {
+                    parts.pop_back();
+                } else if (!absolute) {
+                    parts.push_back(part);
+                }
+            } else if (!part.empty() && part != ".") {
+                parts.push_back(part);
+            }
+            begin = end + 1;
+        }
+
+        std::string normalized = absolute ? "/" : "";
+        for (uint64 i = 0; i < parts.size(); i++) {
+            normalized += (i > 0 ? "/" : "") + parts[i];
+        }
+        return normalized;
+    }
+
+    /**
+     * 2D texture at path, placeholder is shown until a newly requested texture is decoded.
+     * normalMap selects the normal map compression when the texture is loaded.
+     */
+    Handle texture(const std::string& path, const TextureLoader::Color& placeholder = TextureLoader::GREY, bool normalMap = false) {
+        const std::string key = normalize(path);
+        return acquire(key, [&] { return TextureLoader::textureFromFileAsync(key, placeholder, normalMap); });
+    }
+
+    /**
+     * Cube map made of the six faces (+x, -x, +y, -y, +z, -z).
+     */
+    Handle cubeMap(const std::vector<std::string>& faces) {
+        std::vector<std::string> normalized;
+        std::string key = "cubemap:";
+        for (const std::string& face : faces) {
+            normalized.push_back(normalize(face));
+            key += normalized.back() + '|';
+        }
+        return acquire(key, [&] { return TextureLoader::cubeMapFromFiles(normalized); });
+    }
+
+    /**
+     * Number of textures currently alive.
+     */
+    uint64 size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64 alive = 0;
+        for (const auto& entry : entries) {
+            alive += !entry.second.expired();
+        }
+        return alive;
+    }
+};
+
+}; // namespace cglib
@@ -0,0 +1,348 @@
+#pragma once
+
+#include "core_types.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace cglib {
+
+enum class BlockFormat : uint32 {
+    // RGB, 8 bytes per 4x4 block
+    BC1 = 1,
+    // RGBA, BC1 colors plus a BC4 alpha block
+    BC3 = 3,
+    // Two BC4 channels (normal map x and y)
+    BC5 = 5
+};
+
+/**
+ * Full mip chain of a block compressed texture, level 0 first.
+ */
+struct CompressedTexture {
+    BlockFormat format = BlockFormat::BC1;
+    uint32 width = 0, height = 0;
+    std::vector<std::vector<ubyte>> levels;
+};
+
+/**
+ * Builds mip chains on the CPU and encodes them in BCn blocks.
+ *
+ * Color mips are averaged in linear space (the texels stay sRGB encoded), normal map mips are renormalized.
+ * Each level is filtered row-parallel and encoded block-row-parallel on the thread pool.
+ * Results are stored by TextureContainer.
+ */
+class TextureCompressor {
+public:
+    // Bump whenever the encoders change, cached textures of other versions are rebuilt
+    static constexpr uint32 VERSION = 1;
+
+private:
+    static constexpr uint32 LINEAR_TO_SRGB_SIZE = 4096;
+
+    static const std::array<float32, 256>& srgbToLinear() {
+        static const std::array<float32, 256> table = [] {
+            std::array<float32, 256> t;
+            for (uint32 i = 0; i < 256; i++) {
+                const float32 c = i / 255.0f;
+                t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    static const std::array<ubyte, LINEAR_TO_SRGB_SIZE>& linearToSrgb() {
+        static const std::array<ubyte, LINEAR_TO_SRGB_SIZE> table = [] {
+            std::array<ubyte, LINEAR_TO_SRGB_SIZE> t;
+            for (uint32 i = 0; i < LINEAR_TO_SRGB_SIZE; i++) {
+                const float32 c = i / float32(LINEAR_TO_SRGB_SIZE - 1);
+                const float32 s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1 / 2.4f) - 0.055f;
+                t[i] = static_cast<ubyte>(std::lround(std::min(1.0f, s) * 255));
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    static ubyte toByte(float32 v) {
+        return static_cast<ubyte>(std::lround(std::min(1.0f, std::max(0.0f, v)) * 255));
+    }
+
+    static uint16 to565(const ubyte* c) {
+        const uint32 r = (c[0] * 31 + 127) / 255, g = (c[1] * 63 + 127) / 255, b = (c[2] * 31 + 127) / 255;
+        return static_cast<uint16>((r << 11) | (g << 5) | b);
+    }
+
+    static void from565(uint16 v, int32* c) {
+        const int32 r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+        c[0] = (r << 3) | (r >> 2);
+        c[1] = (g << 2) | (g >> 4);
+        c[2] = (b << 3) | (b >> 2);
+    }
+
+    static void store16(ubyte* out, uint16 v) {
+        out[0] = v & 0xFF;
+        out[1] = v >> 8;
+    }
+
+    /**
+     * 4x4 block of RGBA pixels starting at (x, y), edges are clamped for levels smaller than a block.
+     */
+    static void gatherBlock(const ubyte* pixels, uint32 width, uint32 height, uint32 x, uint32 y, ubyte* block) {
+        for (uint32 j = 0; j < 4; j++) {
+            const uint32 row = std::min(y + j, height - 1);
+            for (uint32 i = 0; i < 4; i++) {
+                const uint32 column = std::min(x + i, width - 1);
+                std::memcpy(block + (j * 4 + i) * 4, pixels + (static_cast<uint64>(row) * width + column) * 4, 4);
+            }
+        }
+    }
+
+public:
+    static uint32 blockBytes(BlockFormat format) {
+        return format == BlockFormat::BC1 ? 8 : 16;
+    }
+
+    static uint64 levelSize(BlockFormat format, uint32 width, uint32 height) {
+        return static_cast<uint64>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    static uint32 numLevels(uint32 width, uint32 height) {
+        uint32 levels = 1;
+        while ((width | height) > 1) {
+            width >>= 1;
+            height >>= 1;
+            levels++;
+        }
+        return levels;
+    }
+
+    /**
+     * BC1 block of 16 RGBA pixels. The endpoints are the extreme pixels along the principal axis of the colors.
+     */
+    static void encodeBC1(const ubyte* block, ubyte* out) {
+        float32 mean[3] = {0, 0, 0};
+        for (uint32 i = 0; i < 16; i++) {
+            for (uint32 c = 0; c < 3; c++) mean[c] += block[i * 4 + c];
+        }
+        for (uint32 c = 0; c < 3; c++) mean[c] /= 16;
+
+        float32 cov[6] = {0, 0, 0, 0, 0, 0};
+        for (uint32 i = 0; i < 16; i++) {
+            const float32 r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+
+        // Power iteration for the principal axis
+        float32 axis[3] = {1, 1, 1};
+        for (uint32 k = 0; k < 8; k++) {
+            const float32 x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            const float32 y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            const float32 z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            const float32 m = std::max(std::abs(x), std::max(std::abs(y), std::abs(z)));
+            if (m == 0) break;
+            axis[0] = x / m; axis[1] = y / m; axis[2] = z / m;
+        }
+
+        uint32 minIndex = 0, maxIndex = 0;
+        float32 minProjection = 1e30f, maxProjection = -1e30f;
+        for (uint32 i = 0; i < 16; i++) {
+            const float32 p = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+            if (p < minProjection) { minProjection = p; minIndex = i; }
+            if (p > maxProjection) { maxProjection = p; maxIndex = i; }
+        }
+
+        uint16 c0 = to565(block + maxIndex * 4), c1 = to565(block + minIndex * 4);
+        // c0 > c1 selects the four color mode
+        if (c0 < c1) std::swap(c0, c1);
+        store16(out, c0);
+        store16(out + 2, c1);
+
+        uint32 indices = 0;
+        if (c0 != c1) {
+            int32 palette[4][3];
+            from565(c0, palette[0]);
+            from565(c1, palette[1]);
+            for (uint32 c = 0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (uint32 i = 0; i < 16; i++) {
+                uint32 best = 0;
+                int32 bestDistance = 0x7FFFFFFF;
+                for (uint32 k = 0; k < 4; k++) {
+                    int32 d = 0;
+                    for (uint32 c = 0; c < 3; c++) {
+                        const int32 e = block[i * 4 + c] - palette[k][c];
+                        d += e * e;
+                    }
+                    if (d < bestDistance) { bestDistance = d; best = k; }
+                }
+                indices |= best << (2 * i);
+            }
+        }
+        for (uint32 b = 0; b < 4; b++) out[4 + b] = (indices >> (8 * b)) & 0xFF;
+    }
+
+    /**
+     * BC4 block of 16 single channel values read every stride bytes, in the eight value mode.
+     */
+    static void encodeBC4(const ubyte* values, uint32 stride, ubyte* out) {
+        ubyte lo = 255, hi = 0;
+        for (uint32 i = 0; i < 16; i++) {
+            lo = std::min(lo, values[i * stride]);
+            hi = std::max(hi, values[i * stride]);
+        }
+        out[0] = hi;
+        out[1] = lo;
+
+        uint64 bits = 0;
+        if (hi > lo) {
+            const int32 range = hi - lo;
+            for (uint32 i = 0; i < 16; i++) {
+                // Position between hi (0) and lo (7), palette indices 0 and 1 are the endpoints
+                const int32 p = ((hi - values[i * stride]) * 14 + range) / (2 * range);
+                const uint64 index = p == 0 ? 0 : p == 7 ? 1 : p + 1;
+                bits |= index << (3 * i);
+            }
+        }
+        for (uint32 b = 0; b < 6; b++) out[2 + b] = (bits >> (8 * b)) & 0xFF;
+    }
+
+    static void encodeBlock(BlockFormat format, const ubyte* block, ubyte* out) {
+        if (format == BlockFormat::BC1) {
+            encodeBC1(block, out);
+        } else if (format == BlockFormat::BC3) {
+            encodeBC4(block + 3, 4, out);
+            encodeBC1(block, out + 8);
+        } else {
+            encodeBC4(block, 4, out);
+            encodeBC4(block + 1, 4, out + 8);
+        }
+    }
+
+    static std::vector<ubyte> encodeLevel(BlockFormat format, const ubyte* pixels, uint32 width, uint32 height, ThreadPool& pool) {
+        const uint32 blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        const uint32 bytes = blockBytes(format);
+        std::vector<ubyte> encoded(static_cast<uint64>(blocksX) * blocksY * bytes);
+
+        pool.parallelFor(0, blocksY, 4, [&](uint64 begin, uint64 end) {
+            ubyte block[64];
+            for (uint64 by = begin; by < end; by++) {
+                for (uint32 bx = 0; bx < blocksX; bx++) {
+                    gatherBlock(pixels, width, height, bx * 4, by * 4, block);
+                    encodeBlock(format, block, encoded.data() + (by * blocksX + bx) * bytes);
+                }
+            }
+        });
+        return encoded;
+    }
+
+    /**
+     * Compresses an 8 bit image with 1 to 4 components into a full mip chain.
+     * Normal maps (x, y, z stored in rgb) use BC5, images with transparent texels BC3 and the others BC1.
+     * Single component images are treated like GL_RED: (r, 0, 0, 1).
+     */
+    static CompressedTexture compress(const ubyte* pixels, uint32 width, uint32 height, uint32 components, bool normalMap,
+                                      ThreadPool& pool = ThreadPool::global()) {
+        std::vector<ubyte> rgba(static_cast<uint64>(width) * height * 4);
+        pool.parallelFor(0, height, 64, [&](uint64 begin, uint64 end) {
+            for (uint64 i = begin * width; i < end * width; i++) {
+                const ubyte* in = pixels + i * components;
+                ubyte* out = rgba.data() + i * 4;
+                out[0] = in[0];
+                out[1] = components >= 3 ? in[1] : components == 2 ? in[0] : 0;
+                out[2] = components >= 3 ? in[2] : components == 2 ? in[0] : 0;
+                out[3] = components == 4 ? in[3] : components == 2 ? in[1] : 255;
+            }
+        });
+
+        bool transparent = false;
+        for (uint64 i = 3; i < rgba.size() && !transparent; i += 4) {
+            transparent = rgba[i] < 255;
+        }
+
+        CompressedTexture texture;
+        texture.format = normalMap ? BlockFormat::BC5 : transparent ? BlockFormat::BC3 : BlockFormat::BC1;
+        texture.width = width;
+        texture.height = height;
+        texture.levels.push_back(encodeLevel(texture.format, rgba.data(), width, height, pool));
+
+        const std::array<float32, 256>& toLinear = srgbToLinear();
+        const std::array<ubyte, LINEAR_TO_SRGB_SIZE>& toSrgb = linearToSrgb();
+
+        // Previous level in linear float RGBA, empty while it is the 8 bit level 0
+        std::vector<float32> linear;
+        while (width > 1 || height > 1) {
+            const uint32 nextWidth = std::max(1u, width >> 1), nextHeight = std::max(1u, height >> 1);
+            std::vector<float32> next(static_cast<uint64>(nextWidth) * nextHeight * 4);
+
+            pool.parallelFor(0, nextHeight, 16, [&](uint64 begin, uint64 end) {
+                std::vector<float32> rows(linear.empty() ? static_cast<uint64>(width) * 8 : 0);
+                for (uint64 y = begin; y < end; y++) {
+                    const uint64 y0 = std::min<uint64>(2 * y, height - 1), y1 = std::min<uint64>(2 * y + 1, height - 1);
+                    const float32 *row0, *row1;
+                    if (linear.empty()) {
+                        for (uint64 r = 0; r < 2; r++) {
+                            const ubyte* in = rgba.data() + (r == 0 ? y0 : y1) * width * 4;
+                            float32* out = rows.data() + r * width * 4;
+                            for (uint64 i = 0; i < static_cast<uint64>(width) * 4; i++) {
+                                out[i] = normalMap || (i & 3) == 3 ? in[i] / 255.0f : toLinear[in[i]];
+                            }
+                        }
+                        row0 = rows.data();
+                        row1 = rows.data() + static_cast<uint64>(width) * 4;
+                    } else {
+                        row0 = linear.data() + y0 * width * 4;
+                        row1 = linear.data() + y1 * width * 4;
+                    }
+
+                    float32* out = next.data() + y * nextWidth * 4;
+                    simd::boxFilter2x2(row0, row1, out, nextWidth, width > 1 ? 4 : 0);
+
+                    if (normalMap) {
+                        for (uint32 x = 0; x < nextWidth; x++) {
+                            float32* n = out + x * 4;
+                            const float32 nx = n[0] * 2 - 1, ny = n[1] * 2 - 1, nz = n[2] * 2 - 1;
+                            const float32 length = std::sqrt(nx * nx + ny * ny + nz * nz);
+                            if (length > 0) {
+                                n[0] = nx / length * 0.5f + 0.5f;
+                                n[1] = ny / length * 0.5f + 0.5f;
+                                n[2] = nz / length * 0.5f + 0.5f;
+                            }
+                        }
+                    }
+                }
+            });
+
+            std::vector<ubyte> bytes(next.size());
+            pool.parallelFor(0, next.size(), 1 << 16, [&](uint64 begin, uint64 end) {
+                for (uint64 i = begin; i < end; i++) {
+                    if (normalMap || (i & 3) == 3) {
+                        bytes[i] = toByte(next[i]);
+                    } else {
+                        const float32 v = std::min(1.0f, std::max(0.0f, next[i]));
+                        bytes[i] = toSrgb[static_cast<uint32>(v * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)];
+                    }
+                }
+            });
+            texture.levels.push_back(encodeLevel(texture.format, bytes.data(), nextWidth, nextHeight, pool));
+
+            linear = std::move(next);
+            width = nextWidth;
+            height = nextHeight;
+        }
+        return texture;
+    }
+};
+
+}; // namespace cglib
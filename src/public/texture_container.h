@@ -0,0 +1,239 @@
+#pragma once
+
+#include "core_types.h"
+#include "mapped_file.h"
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Memory mapped file holding the block compressed mip chains of a 2D texture (one face) or a cube map (six faces).
+ *
+ * Layout: Header, SourceRecord[numFaces], LevelRecord[numFaces * numLevels] (face major), then the level data,
+ * each level aligned to DATA_ALIGNMENT. Levels are uploaded straight from the mapping.
+ * A container is valid only for the current VERSION and TextureCompressor::VERSION, the same list of source images
+ * and while each source keeps the recorded size and modification time (missing sources do not invalidate it).
+ */
+class TextureContainer {
+public:
+    static constexpr uint32 VERSION = 2;
+
+private:
+    static constexpr char MAGIC[4] = {'C', 'G', 'T', 'X'};
+    static constexpr uint64 DATA_ALIGNMENT = 16;
+
+    struct Header {
+        char magic[4];
+        uint32 version;
+        uint32 compressorVersion;
+        uint32 format;
+        uint32 width, height;
+        uint32 numLevels, numFaces;
+        uint64 sourcesHash;
+    };
+
+    struct SourceRecord {
+        uint64 size;
+        int64 mtime;
+    };
+
+    struct LevelRecord {
+        uint64 offset, size;
+    };
+
+    static_assert(sizeof(Header) % 8 == 0, "Misaligned container records");
+
+    MappedFile file;
+
+    static uint64 align(uint64 offset) {
+        return (offset + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+    }
+
+    // FNV-1a over the source file names, a container is never used for another set of images.
+    // Directories are left out, the container sits next to the sources however they are reached.
+    static uint64 hashSources(const std::vector<std::string>& sources) {
+        uint64 h = 0xcbf29ce484222325ull;
+        for (const std::string& source : sources) {
+            for (char c : source.substr(source.find_last_of('/') + 1)) {
+                h = (h ^ static_cast<ubyte>(c)) * 0x100000001b3ull;
+            }
+            h = (h ^ '\n') * 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    const Header& header() const {
+        return *reinterpret_cast<const Header*>(file.getData());
+    }
+
+    const LevelRecord* levelRecords() const {
+        return reinterpret_cast<const LevelRecord*>(file.getData() + sizeof(Header) + header().numFaces * sizeof(SourceRecord));
+    }
+
+public:
+    static std::string cachePath(const std::string& sourcePath) {
+        return sourcePath + ".cgtex";
+    }
+
+    static std::string cubeMapCachePath(const std::vector<std::string>& faces) {
+        return faces[0] + ".cube.cgtex";
+    }
+
+    /**
+     * Writes the faces (same format and size) compressed from sources, through a temporary file renamed at the end.
+     */
+    static bool write(const std::string& path, const std::vector<std::string>& sources, const std::vector<CompressedTexture>& faces) {
+        if (faces.empty() || faces.size() != sources.size()) return false;
+
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, 4);
+        header.version = VERSION;
+        header.compressorVersion = TextureCompressor::VERSION;
+        header.format = static_cast<uint32>(faces[0].format);
+        header.width = faces[0].width;
+        header.height = faces[0].height;
+        header.numLevels = faces[0].levels.size();
+        header.numFaces = faces.size();
+        header.sourcesHash = hashSources(sources);
+
+        std::vector<SourceRecord> sourceRecords(sources.size());
+        for (uint32 i = 0; i < sources.size(); i++) {
+            if (!MappedFile::stamp(sources[i], sourceRecords[i].size, sourceRecords[i].mtime)) return false;
+        }
+
+        std::vector<LevelRecord> levelRecords;
+        uint64 offset = sizeof(Header) + sourceRecords.size() * sizeof(SourceRecord) +
+                        static_cast<uint64>(faces.size()) * header.numLevels * sizeof(LevelRecord);
+        for (const CompressedTexture& face : faces) {
+            if (face.format != faces[0].format || face.width != header.width || face.height != header.height ||
+                face.levels.size() != header.numLevels) {
+                return false;
+            }
+            for (const std::vector<ubyte>& level : face.levels) {
+                offset = align(offset);
+                levelRecords.push_back({offset, level.size()});
+                offset += level.size();
+            }
+        }
+
+        const std::string temporaryPath = path + ".tmp";
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        out.write(reinterpret_cast<const char*>(sourceRecords.data()), sourceRecords.size() * sizeof(SourceRecord));
+        out.write(reinterpret_cast<const char*>(levelRecords.data()), levelRecords.size() * sizeof(LevelRecord));
+
+        const char padding[DATA_ALIGNMENT] = {};
+        uint64 position = sizeof(Header) + sourceRecords.size() * sizeof(SourceRecord) + levelRecords.size() * sizeof(LevelRecord);
+        uint32 record = 0;
+        for (const CompressedTexture& face : faces) {
+            for (const std::vector<ubyte>& level : face.levels) {
+                out.write(padding, levelRecords[record].offset - position);
+                out.write(reinterpret_cast<const char*>(level.data()), level.size());
+                position = levelRecords[record].offset + level.size();
+                record++;
+            }
+        }
+
+        out.close();
+        if (!out) {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+
+    explicit TextureContainer(const std::string& path) : file(path) {}
+
+    /**
+     * Whether the mapping is a complete container built from sources, in their current version.
+     */
+    bool isValid(const std::vector<std::string>& sources) const {
+        if (!file.isOpen() || file.getSize() < sizeof(Header)) return false;
+
+        const Header& h = header();
+        if (std::memcmp(h.magic, MAGIC, 4) != 0 || h.version != VERSION || h.compressorVersion != TextureCompressor::VERSION) {
+            return false;
+        }
+        const BlockFormat format = static_cast<BlockFormat>(h.format);
+        if ((format != BlockFormat::BC1 && format != BlockFormat::BC3 && format != BlockFormat::BC5) || h.width == 0 || h.height == 0 ||
+            h.numLevels != TextureCompressor::numLevels(h.width, h.height) || h.numFaces != sources.size() ||
+            h.sourcesHash != hashSources(sources)) {
+            return false;
+        }
+
+        const uint64 tablesSize = sizeof(Header) + h.numFaces * sizeof(SourceRecord) + static_cast<uint64>(h.numFaces) * h.numLevels * sizeof(LevelRecord);
+        if (tablesSize > file.getSize()) return false;
+
+        const SourceRecord* sourceRecords = reinterpret_cast<const SourceRecord*>(file.getData() + sizeof(Header));
+        for (uint32 i = 0; i < sources.size(); i++) {
+            uint64 size;
+            int64 mtime;
+            if (MappedFile::stamp(sources[i], size, mtime) && (size != sourceRecords[i].size || mtime != sourceRecords[i].mtime)) {
+                return false;
+            }
+        }
+
+        // Truncated or corrupted files are treated as stale
+        const LevelRecord* records = levelRecords();
+        for (uint32 face = 0; face < h.numFaces; face++) {
+            uint32 width = h.width, height = h.height;
+            for (uint32 level = 0; level < h.numLevels; level++) {
+                const LevelRecord& r = records[face * h.numLevels + level];
+                if (r.size != TextureCompressor::levelSize(format, width, height) || r.offset < tablesSize ||
+                    r.offset + r.size > file.getSize()) {
+                    return false;
+                }
+                width = std::max(1u, width >> 1);
+                height = std::max(1u, height >> 1);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Starts reading the level data in the background, e.g. on a worker before the GL thread uploads it.
+     */
+    void prefetch() const {
+        file.prefetch();
+    }
+
+    BlockFormat getFormat() const {
+        return static_cast<BlockFormat>(header().format);
+    }
+
+    uint32 getWidth() const {
+        return header().width;
+    }
+
+    uint32 getHeight() const {
+        return header().height;
+    }
+
+    uint32 getNumLevels() const {
+        return header().numLevels;
+    }
+
+    uint32 getNumFaces() const {
+        return header().numFaces;
+    }
+
+    /**
+     * Compressed blocks of a level, pointing into the mapping. Only valid containers can be accessed.
+     */
+    const ubyte* getLevel(uint32 face, uint32 level, uint64& size) const {
+        const LevelRecord& r = levelRecords()[face * header().numLevels + level];
+        size = r.size;
+        return file.getData() + r.offset;
+    }
+};
+
+}; // namespace cglib
@@ -2,7 +2,19 @@
 
 #include <glad/glad.h>
 
+#include "core_types.h"
+#include "thread_pool.h"
+#include "texture_compression.h"
+#include "texture_container.h"
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -13,9 +25,19 @@
 #endif
 #include "stb_image.h"
 
+// EXT_texture_compression_s3tc, not part of the core profile header
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
 namespace cglib {
 
 class TextureLoader {
+public:
+    using Color = std::array<ubyte, 4>;
 
 private:
     static std::string fixPath(const std::string& toFix) {
@@ -36,7 +58,270 @@ private:
         return std::string(fixed.data());
     }
 
+    // Decoded pixels, freed with stbi_image_free once the last copy is gone
+    struct Image {
+        int32 width = 0, height = 0, components = 0;
+        std::shared_ptr<ubyte> pixels;
+    };
+
+    // Uploads decoded on the workers and waiting for the GL thread
+    struct AsyncState {
+        std::mutex mutex;
+        std::vector<std::function<void()>> completed;
+        std::atomic<uint32> pending {0};
+        // Textures waiting for their upload, true if deleted in the meantime
+        std::unordered_map<uint32, bool> inFlight;
+        bool contextLost = false;
+        // Read when loads start, without the mutex
+        std::atomic<bool> compression {true};
+    };
+
+    static AsyncState& asyncState() {
+        // Never destroyed, decoding tasks may still complete while static objects are torn down
+        static AsyncState* state = new AsyncState();
+        return *state;
+    }
+
+    static Image decode(const std::string& path) {
+        Image image;
+        ubyte* data = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+        if (data) {
+            image.pixels = std::shared_ptr<ubyte>(data, stbi_image_free);
+        }
+        return image;
+    }
+
+    static GLenum format(int32 components) {
+        if (components == 1)
+            return GL_RED;
+        else if (components == 3)
+            return GL_RGB;
+        return GL_RGBA;
+    }
+
+    static void upload(uint32 textureID, const Image& image) {
+        // Rows of 1 and 3 component images are not 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        const GLenum fmt = format(image.components);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, fmt, image.width, image.height, 0, fmt, GL_UNSIGNED_BYTE, image.pixels.get());
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        // Chooses the two mipmaps that most closely match the size of the pixel being textured and uses the GL_LINEAR criterion (a weighted average of the four texture elements that are closest to the center of the pixel)
+        // to produce a texture value from each mipmap. The final texture value is a weighted average of those two values.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+        // Returns the weighted average of the four texture elements that are closest to the center of the pixel being textured.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    // Compressed faces ready for upload, mapped from an up to date container or compressed on the spot
+    struct CompressedSource {
+        std::shared_ptr<const TextureContainer> container;
+        std::vector<CompressedTexture> faces;
+
+        BlockFormat getFormat() const {
+            return container ? container->getFormat() : faces[0].format;
+        }
+
+        uint32 getNumFaces() const {
+            return container ? container->getNumFaces() : faces.size();
+        }
+
+        uint32 getNumLevels() const {
+            return container ? container->getNumLevels() : faces[0].levels.size();
+        }
+
+        uint32 getWidth() const {
+            return container ? container->getWidth() : faces[0].width;
+        }
+
+        uint32 getHeight() const {
+            return container ? container->getHeight() : faces[0].height;
+        }
+
+        const ubyte* getLevel(uint32 face, uint32 level, uint64& size) const {
+            if (container) return container->getLevel(face, level, size);
+            size = faces[face].levels[level].size();
+            return faces[face].levels[level].data();
+        }
+    };
+
+    static std::vector<Image> decodeAll(const std::vector<std::string>& paths, ThreadPool& pool) {
+        std::vector<Image> images(paths.size());
+        pool.parallelFor(0, paths.size(), 1, [&](uint64 begin, uint64 end) {
+            for (uint64 i = begin; i < end; i++) images[i] = decode(paths[i]);
+        });
+        return images;
+    }
+
+    /**
+     * Uploads every face and level of source to a GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP texture.
+     * Levels of a mapped container are read straight from the mapping.
+     */
+    static void uploadCompressed(GLenum target, uint32 textureID, const CompressedSource& source) {
+        const BlockFormat blockFormat = source.getFormat();
+        const GLenum internalFormat = blockFormat == BlockFormat::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT :
+                                      blockFormat == BlockFormat::BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT :
+                                                                        GL_COMPRESSED_RG_RGTC2;
+        glBindTexture(target, textureID);
+        for (uint32 face = 0; face < source.getNumFaces(); face++) {
+            const GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+            uint32 width = source.getWidth(), height = source.getHeight();
+            for (uint32 level = 0; level < source.getNumLevels(); level++) {
+                uint64 size;
+                const ubyte* data = source.getLevel(face, level, size);
+                glCompressedTexImage2D(faceTarget, level, internalFormat, width, height, 0, size, data);
+                width = std::max(1u, width >> 1);
+                height = std::max(1u, height >> 1);
+            }
+        }
+
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, source.getNumLevels() - 1);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (target == GL_TEXTURE_CUBE_MAP) {
+            glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        } else {
+            glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        }
+    }
+
+    /**
+     * Compressed mip chains of the images at paths (one, or the six faces of a cube map), mapped from the container
+     * at cachePath when it is up to date, otherwise decoded, compressed and stored there.
+     * Returns false if the images cannot be compressed together, leaving whatever was decoded in images.
+     */
+    static bool loadCompressed(const std::vector<std::string>& paths, const std::string& cachePath, bool normalMap, ThreadPool& pool,
+                               CompressedSource& source, std::vector<Image>& images) {
+        auto container = std::make_shared<const TextureContainer>(cachePath);
+        if (container->isValid(paths)) {
+            // Pages are read in the background, the GL thread uploads from the mapping
+            container->prefetch();
+            source.container = std::move(container);
+            return true;
+        }
+
+        images = decodeAll(paths, pool);
+        for (const Image& image : images) {
+            if (!image.pixels || image.width != images[0].width || image.height != images[0].height) return false;
+        }
+
+        source.faces.resize(paths.size());
+        pool.parallelFor(0, paths.size(), 1, [&](uint64 begin, uint64 end) {
+            for (uint64 i = begin; i < end; i++) {
+                const Image& image = images[i];
+                source.faces[i] = TextureCompressor::compress(image.pixels.get(), image.width, image.height, image.components, normalMap, pool);
+            }
+        });
+        for (const CompressedTexture& face : source.faces) {
+            // e.g. a cube map with a single transparent face
+            if (face.format != source.faces[0].format) return false;
+        }
+
+        if (!TextureContainer::write(cachePath, paths, source.faces)) {
+            std::cout << "WARNING::TEXTURE_CACHE:: could not write " << cachePath << std::endl;
+        }
+        return true;
+    }
+
+    /**
+     * Whether the context can sample the BCn formats written by TextureCompressor, must be called on the GL thread.
+     */
+    static bool supportsCompression() {
+        static const bool supported = [] {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++) {
+                const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+                if (name != nullptr && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) return true;
+            }
+            return false;
+        }();
+        return supported;
+    }
+
+    static void uploadCubeMap(uint32 textureID, const std::vector<Image>& faces, const std::vector<std::string>& paths) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        for (uint32 i = 0; i < faces.size(); i++) {
+            if (faces[i].pixels) {
+                const GLenum fmt = format(faces[i].components);
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, fmt, faces[i].width, faces[i].height, 0, fmt, GL_UNSIGNED_BYTE,
+                             faces[i].pixels.get());
+            } else {
+                std::cout << "Cubemap texture failed to load at path: " << paths[i] << std::endl;
+            }
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    static Image placeholder(const Color& color) {
+        Image image;
+        image.width = image.height = 1;
+        image.components = 4;
+        image.pixels = std::shared_ptr<ubyte>(new ubyte[4] {color[0], color[1], color[2], color[3]}, std::default_delete<ubyte[]>());
+        return image;
+    }
+
+    static void start(uint32 textureID) {
+        AsyncState& state = asyncState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.pending++;
+        state.inFlight[textureID] = false;
+    }
+
+    static void complete(uint32 textureID, std::function<void()> job) {
+        AsyncState& state = asyncState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.contextLost) {
+            state.pending--;
+            return;
+        }
+        state.completed.push_back([textureID, job = std::move(job)] {
+            AsyncState& state = asyncState();
+            bool deleted;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                deleted = state.inFlight[textureID];
+                state.inFlight.erase(textureID);
+            }
+            if (deleted) {
+                glDeleteTextures(1, &textureID);
+            } else {
+                job();
+            }
+        });
+    }
+
 public:
+    // Placeholders shown until an asynchronous texture is uploaded
+    static constexpr Color GREY = {128, 128, 128, 255};
+    static constexpr Color FLAT_NORMAL = {128, 128, 255, 255};
+    static constexpr Color BLACK = {0, 0, 0, 255};
+
+    /**
+     * Placeholder matching the sampler names used by Mesh, so that unlit or unbumped surfaces look neutral.
+     */
+    static Color placeholderFor(const std::string& type) {
+        if (type == "texture_normal") return FLAT_NORMAL;
+        if (type == "texture_specular") return BLACK;
+        return GREY;
+    }
 
     static uint32 textureFromFile(std::string& path)
     {
@@ -45,41 +330,167 @@ public:
 
         path = fixPath(path);
 
-        int32 width, height, nrComponents;
-        ubyte *data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-        if (data)
+        const Image image = decode(path);
+        if (image.pixels)
+        {
+            upload(textureID, image);
+        }
+        else
         {
-            GLenum format;
-            if (nrComponents == 1)
-                format = GL_RED;
-            else if (nrComponents == 3)
-                format = GL_RGB;
-            else if (nrComponents == 4)
-                format = GL_RGBA;
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+        }
 
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
+        return textureID;
+    }
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    /**
+     * Returns a texture holding a 1x1 placeholder right away and decodes the file on pool.
+     * The decoded image replaces the placeholder in the same texture object once processCompleted runs
+     * on the GL thread, so the id can be handed to meshes immediately.
+     * With compression enabled the image is uploaded as a BCn mip chain built by TextureCompressor (BC5 if normalMap),
+     * which is cached next to the file so that later runs skip decoding.
+     */
+    static uint32 textureFromFileAsync(const std::string& path, const Color& color = GREY, bool normalMap = false,
+                                       ThreadPool& pool = ThreadPool::global())
+    {
+        uint32 textureID;
+        glGenTextures(1, &textureID);
+        upload(textureID, placeholder(color));
 
-            // Chooses the two mipmaps that most closely match the size of the pixel being textured and uses the GL_LINEAR criterion (a weighted average of the four texture elements that are closest to the center of the pixel)
-            // to produce a texture value from each mipmap. The final texture value is a weighted average of those two values.
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        start(textureID);
+        if (asyncState().compression && supportsCompression()) {
+            pool.submit([textureID, path = fixPath(path), normalMap, &pool] {
+                auto source = std::make_shared<CompressedSource>();
+                std::vector<Image> images;
+                const bool loaded = loadCompressed({path}, TextureContainer::cachePath(path), normalMap, pool, *source, images);
+                complete(textureID, [textureID, path, source, loaded] {
+                    if (loaded) {
+                        uploadCompressed(GL_TEXTURE_2D, textureID, *source);
+                    } else {
+                        std::cout << "Texture failed to load at path: " << path << std::endl;
+                    }
+                });
+            });
+            return textureID;
+        }
 
-            // Returns the weighted average of the four texture elements that are closest to the center of the pixel being textured.
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        pool.submit([textureID, path = fixPath(path)] {
+            const Image image = decode(path);
+            complete(textureID, [textureID, path, image] {
+                if (image.pixels) {
+                    upload(textureID, image);
+                } else {
+                    std::cout << "Texture failed to load at path: " << path << std::endl;
+                }
+            });
+        });
+        return textureID;
+    }
+
+    /**
+     * Enables (default) or disables block compression of the textures loaded asynchronously from now on.
+     */
+    static void setCompression(bool enabled)
+    {
+        asyncState().compression = enabled;
+    }
 
-            stbi_image_free(data);
+    /**
+     * Cube map from six faces (+x, -x, +y, -y, +z, -z), decoded on pool when async is set.
+     * Faces are uploaded together so the cube map never mixes placeholder and decoded faces.
+     * Asynchronous cube maps are compressed like 2D textures, in a single container for the six faces.
+     */
+    static uint32 cubeMapFromFiles(const std::vector<std::string>& faces, bool async = true, const Color& color = GREY,
+                                   ThreadPool& pool = ThreadPool::global())
+    {
+        uint32 textureID;
+        glGenTextures(1, &textureID);
+
+        if (!async) {
+            uploadCubeMap(textureID, decodeAll(faces, pool), faces);
+            return textureID;
         }
-        else
+
+        uploadCubeMap(textureID, std::vector<Image>(faces.size(), placeholder(color)), faces);
+        start(textureID);
+        const bool compressed = asyncState().compression && supportsCompression();
+        pool.submit([textureID, faces, compressed, &pool] {
+            auto source = std::make_shared<CompressedSource>();
+            std::vector<Image> images;
+            if (compressed && loadCompressed(faces, TextureContainer::cubeMapCachePath(faces), false, pool, *source, images)) {
+                complete(textureID, [textureID, source] { uploadCompressed(GL_TEXTURE_CUBE_MAP, textureID, *source); });
+                return;
+            }
+
+            if (images.empty()) {
+                images = decodeAll(faces, pool);
+            }
+            complete(textureID, [textureID, faces, images] { uploadCubeMap(textureID, images, faces); });
+        });
+        return textureID;
+    }
+
+    /**
+     * Uploads up to maxUploads textures decoded since the last call, must be called on the GL thread
+     * (e.g. once per frame). Returns the number of uploads done.
+     */
+    static uint32 processCompleted(uint32 maxUploads = 0xFFFFFFFF)
+    {
+        AsyncState& state = asyncState();
+        std::vector<std::function<void()>> uploads;
         {
-            std::cout << "Texture failed to load at path: " << path << std::endl;
-            stbi_image_free(data);
+            std::lock_guard<std::mutex> lock(state.mutex);
+            const uint64 count = std::min<uint64>(maxUploads, state.completed.size());
+            uploads.assign(std::make_move_iterator(state.completed.begin()), std::make_move_iterator(state.completed.begin() + count));
+            state.completed.erase(state.completed.begin(), state.completed.begin() + count);
         }
 
-        return textureID;
+        for (const auto& job : uploads) {
+            job();
+        }
+        state.pending -= uploads.size();
+        return uploads.size();
+    }
+
+    /**
+     * Deletes a texture on the GL thread. If it is still being decoded, the deletion happens when its upload
+     * is processed instead, so that the name cannot be reused by another texture in the meantime.
+     */
+    static void deleteTexture(uint32 textureID)
+    {
+        AsyncState& state = asyncState();
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.contextLost) return;
+
+            auto it = state.inFlight.find(textureID);
+            if (it != state.inFlight.end()) {
+                it->second = true;
+                return;
+            }
+        }
+        glDeleteTextures(1, &textureID);
+    }
+
+    /**
+     * Call before destroying the GL context: queued uploads are dropped and textures released
+     * afterwards (e.g. by static or stack objects destroyed later) are not deleted, they went with the context.
+     */
+    static void shutdown()
+    {
+        AsyncState& state = asyncState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.contextLost = true;
+        state.pending -= state.completed.size();
+        state.completed.clear();
+    }
+
+    /**
+     * Asynchronous textures not uploaded yet, decoding or waiting for processCompleted.
+     */
+    static uint32 pending()
+    {
+        return asyncState().pending;
     }
 };
 
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "core_types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Fixed size pool of worker threads.
+ * parallelFor can be safely called from inside a task: the calling thread always works on the range too,
+ * so nested calls never wait on tasks that are still queued.
+ */
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    struct RangeState {
+        std::atomic<uint64> nextChunk {0};
+        uint64 numChunks = 0;
+        uint64 doneChunks = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    template <typename F>
+    static void runChunks(RangeState& state, uint64 begin, uint64 end, uint64 grain, F& f) {
+        uint64 chunk;
+        while ((chunk = state.nextChunk.fetch_add(1)) < state.numChunks) {
+            const uint64 chunkBegin = begin + chunk * grain;
+            f(chunkBegin, std::min(chunkBegin + grain, end));
+
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (++state.doneChunks == state.numChunks) {
+                state.done.notify_all();
+            }
+        }
+    }
+
+public:
+    explicit ThreadPool(uint32 numThreads = std::max(1u, std::thread::hardware_concurrency())) {
+        for (uint32 i = 0; i < numThreads; i++) {
+            workers.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+                        if (stopping && tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(tasks.front());
+                        tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Process wide pool sized to the number of hardware threads.
+     */
+    static ThreadPool& global() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    uint32 size() const {
+        return workers.size();
+    }
+
+    template <typename F>
+    auto submit(F&& f) -> std::future<decltype(f())> {
+        using R = decltype(f());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([task] { (*task)(); });
+        }
+        condition.notify_one();
+        return result;
+    }
+
+    /**
+     * Calls f(chunkBegin, chunkEnd) over [begin, end) split in chunks of grain elements
+     * and returns once every chunk has been processed.
+     */
+    template <typename F>
+    void parallelFor(uint64 begin, uint64 end, uint64 grain, F&& f) {
+        if (end <= begin) return;
+        grain = std::max<uint64>(grain, 1);
+
+        auto state = std::make_shared<RangeState>();
+        state->numChunks = (end - begin + grain - 1) / grain;
+
+        if (state->numChunks == 1) {
+            f(begin, end);
+            return;
+        }
+
+        const uint64 numHelpers = std::min<uint64>(workers.size(), state->numChunks - 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (uint64 i = 0; i < numHelpers; i++) {
+                tasks.emplace([state, begin, end, grain, &f] { runChunks(*state, begin, end, grain, f); });
+            }
+        }
+        condition.notify_all();
+
+        runChunks(*state, begin, end, grain, f);
+
+        // Helpers still in the queue will find no chunks left, only the running ones are waited for
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&state] { return state->doneChunks == state->numChunks; });
+    }
+};
+
+}; // namespace cglib
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "core_types.h"
+#include "mat3.h"
+#include "mat4.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace cglib {
+
+/**
+ * Local and world transforms of a node tree, stored in flat arrays in depth first preorder:
+ * parents come before their children and every subtree is the contiguous range [i, subtreeEnd(i)).
+ * Changing a local transform only flags it, update() then recomputes the changed subtrees in one linear pass,
+ * split into independent subtrees across a ThreadPool for large hierarchies.
+ */
+template <typename T = float32>
+class TransformHierarchy {
+public:
+    static constexpr uint32 NO_PARENT = 0xFFFFFFFF;
+
+private:
+    // Nodes updated by a single task
+    static constexpr uint32 UPDATE_GRAIN = 256;
+
+    std::vector<uint32> parents;
+    std::vector<uint32> subtreeEnds;
+    std::vector<Mat4<T>> locals;
+    std::vector<Mat4<T>> worlds;
+    // Computed on first use after the world transform changed
+    std::vector<Mat3<T>> normalMatrices;
+    std::vector<ubyte> normalMatrixValid;
+    // Local transform changed since the last update
+    std::vector<ubyte> dirty;
+    bool anyDirty = false;
+
+public:
+    TransformHierarchy() {}
+
+    /**
+     * parents[i] is the slot of the parent of slot i (NO_PARENT for roots), the slots must be in depth first preorder.
+     * Every transform starts as the identity.
+     */
+    bool reset(const std::vector<uint32>& parents) {
+        const uint32 n = parents.size();
+
+        // Subtree sizes, children always come after their parent
+        std::vector<uint32> sizes(n, 1);
+        for (uint32 i = n; i-- > 0;) {
+            const uint32 parent = parents[i];
+            if (parent == NO_PARENT) continue;
+            if (parent >= i) {
+                std::cout << "ERROR::TRANSFORM_HIERARCHY:: node " << i << " comes before its parent" << std::endl;
+                return false;
+            }
+            sizes[parent] += sizes[i];
+        }
+
+        std::vector<uint32> ends(n);
+        for (uint32 i = 0; i < n; i++) {
+            ends[i] = i + sizes[i];
+            // In preorder every node lies inside the range of its parent
+            if (parents[i] != NO_PARENT && i >= ends[parents[i]]) {
+                std::cout << "ERROR::TRANSFORM_HIERARCHY:: nodes are not in depth first order" << std::endl;
+                return false;
+            }
+        }
+
+        this->parents = parents;
+        subtreeEnds = std::move(ends);
+        locals.assign(n, Mat4<T>::identity());
+        worlds.assign(n, Mat4<T>::identity());
+        normalMatrices.assign(n, Mat3<T>::identity());
+        normalMatrixValid.assign(n, 1);
+        dirty.assign(n, 0);
+        anyDirty = false;
+        return true;
+    }
+
+    /**
+     * Appends a copy of tree (hierarchy and local transforms) after the current nodes, still in preorder.
+     * Returns the slot of its first node, tree slot i becomes that slot + i.
+     */
+    uint32 append(const TransformHierarchy<T>& tree) {
+        const uint32 offset = size();
+        for (uint32 i = 0; i < tree.size(); i++) {
+            const bool root = tree.parents[i] == NO_PARENT;
+            parents.push_back(root ? NO_PARENT : tree.parents[i] + offset);
+            subtreeEnds.push_back(tree.subtreeEnds[i] + offset);
+            locals.push_back(tree.locals[i]);
+            worlds.push_back(tree.worlds[i]);
+            normalMatrices.push_back(Mat3<T>::identity());
+            normalMatrixValid.push_back(0);
+            // Recomputes the whole copy on the next update
+            dirty.push_back(root);
+            anyDirty = anyDirty || root;
+        }
+        return offset;
+    }
+
+    uint32 size() const {
+        return parents.size();
+    }
+
+    uint32 getParent(uint32 i) const {
+        return parents[i];
+    }
+
+    // One past the last descendant of i
+    uint32 getSubtreeEnd(uint32 i) const {
+        return subtreeEnds[i];
+    }
+
+    const Mat4<T>& getLocal(uint32 i) const {
+        return locals[i];
+    }
+
+    void setLocal(uint32 i, const Mat4<T>& local) {
+        locals[i] = local;
+        dirty[i] = 1;
+        anyDirty = true;
+    }
+
+    /**
+     * World transform as of the last update().
+     */
+    const Mat4<T>& getWorld(uint32 i) const {
+        return worlds[i];
+    }
+
+    /**
+     * Transposed inverse of the upper 3x3 of the world transform.
+     */
+    const Mat3<T>& getNormalMatrix(uint32 i) {
+        if (!normalMatrixValid[i]) {
+            normalMatrices[i] = worlds[i].mat3().transposedInverse();
+            normalMatrixValid[i] = 1;
+        }
+        return normalMatrices[i];
+    }
+
+    bool isDirty() const {
+        return anyDirty;
+    }
+
+    /**
+     * Recomputes the world transforms of the changed nodes and all their descendants, parents first.
+     * Unchanged subtrees are skipped whole. If a pool is given large updates are split across its threads.
+     * Returns the number of recomputed nodes.
+     */
+    uint32 update(ThreadPool* pool = nullptr) {
+        if (!anyDirty) return 0;
+
+        // Dirty subtrees, the parent of each root is clean
+        std::vector<std::pair<uint32, uint32>> ranges;
+        uint32 updated = 0;
+        uint32 i = 0;
+        while (i < size()) {
+            if (!dirty[i]) {
+                i++;
+                continue;
+            }
+            ranges.push_back({i, subtreeEnds[i]});
+            updated += subtreeEnds[i] - i;
+            i = subtreeEnds[i];
+        }
+        anyDirty = false;
+
+        if (pool == nullptr || updated < 2 * UPDATE_GRAIN) {
+            for (const auto& range : ranges) {
+                updateRange(range.first, range.second);
+            }
+            return updated;
+        }
+
+        // A few tasks per thread, each a range of whole subtrees whose parents are up to date
+        const uint32 taskSize = std::max<uint32>(UPDATE_GRAIN, updated / (4 * (pool->size() + 1)));
+
+        // Once the root of a large subtree is computed its child subtrees are independent of each other,
+        // runs of small siblings are contiguous and become a single task.
+        // Subtrees are stacked in reverse so they are visited in node order.
+        std::reverse(ranges.begin(), ranges.end());
+        std::vector<std::pair<uint32, uint32>> tasks;
+        while (!ranges.empty()) {
+            const std::pair<uint32, uint32> range = ranges.back();
+            ranges.pop_back();
+            if (range.second - range.first <= taskSize) {
+                tasks.push_back(range);
+                continue;
+            }
+
+            updateRange(range.first, range.first + 1);
+            const uint64 firstChild = ranges.size();
+            uint32 runBegin = range.first + 1;
+            for (uint32 child = range.first + 1; child < range.second; child = subtreeEnds[child]) {
+                if (subtreeEnds[child] - child > taskSize) {
+                    if (runBegin < child) tasks.push_back({runBegin, child});
+                    ranges.push_back({child, subtreeEnds[child]});
+                    runBegin = subtreeEnds[child];
+                } else if (subtreeEnds[child] - runBegin >= taskSize) {
+                    tasks.push_back({runBegin, subtreeEnds[child]});
+                    runBegin = subtreeEnds[child];
+                }
+            }
+            if (runBegin < range.second) tasks.push_back({runBegin, range.second});
+            std::reverse(ranges.begin() + firstChild, ranges.end());
+        }
+
+        // Small tasks are grouped, each group is updated in order by one thread
+        std::vector<uint32> groups = {0};
+        uint32 groupSize = 0;
+        for (uint32 t = 0; t < tasks.size(); t++) {
+            groupSize += tasks[t].second - tasks[t].first;
+            if (groupSize >= taskSize) {
+                groups.push_back(t + 1);
+                groupSize = 0;
+            }
+        }
+        if (groups.back() != tasks.size()) groups.push_back(tasks.size());
+
+        pool->parallelFor(0, groups.size() - 1, 1, [&](uint64 begin, uint64 end) {
+            for (uint64 g = begin; g < end; g++) {
+                for (uint32 t = groups[g]; t < groups[g + 1]; t++) {
+                    updateRange(tasks[t].first, tasks[t].second);
+                }
+            }
+        });
+        return updated;
+    }
+
+private:
+    // Nodes in [begin, end) in order, the range holds whole subtrees whose parents are up to date
+    void updateRange(uint32 begin, uint32 end) {
+        for (uint32 j = begin; j < end; j++) {
+            const uint32 parent = parents[j];
+            worlds[j] = parent == NO_PARENT ? locals[j] : worlds[parent].dot(locals[j]);
+            normalMatrixValid[j] = 0;
+            dirty[j] = 0;
+        }
+    }
+};
+
+}; // namespace cglib